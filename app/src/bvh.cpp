@@ -0,0 +1,169 @@
+#include "bvh.h"
+#include <algorithm>
+#include <math.h>
+
+void BoundingBox::Expand(const BoundingBox& box)
+{
+    min.x = std::min(min.x, box.min.x);
+    min.y = std::min(min.y, box.min.y);
+    min.z = std::min(min.z, box.min.z);
+    max.x = std::max(max.x, box.max.x);
+    max.y = std::max(max.y, box.max.y);
+    max.z = std::max(max.z, box.max.z);
+}
+
+Vector3d BoundingBox::Center() const
+{
+    return Vector3d((min.x + max.x) * 0.5, (min.y + max.y) * 0.5, (min.z + max.z) * 0.5);
+}
+
+bool BoundingBox::operator==(const BoundingBox& box) const
+{
+    return min.x == box.min.x && min.y == box.min.y && min.z == box.min.z &&
+        max.x == box.max.x && max.y == box.max.y && max.z == box.max.z;
+}
+
+void BVH::Build(const std::vector<BoundingBox>& itemBounds)
+{
+    bounds = itemBounds;
+    nodes.clear();
+    items.resize(bounds.size());
+    itemLeaves.resize(bounds.size());
+    for (size_t i = 0; i < items.size(); i++) items[i] = static_cast<int>(i);
+
+    if (!items.empty()) BuildNode(0, static_cast<int>(items.size()), -1);
+}
+
+int BVH::BuildNode(int first, int count, int parent)
+{
+    int node = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+    nodes[node].parent = parent;
+    nodes[node].first = first;
+    nodes[node].count = count;
+
+    if (count <= MaxLeafItems)
+    {
+        for (int i = first; i < first + count; i++) itemLeaves[items[i]] = node;
+        UpdateLeafBounds(node);
+        return node;
+    }
+
+    // Split at the median of the centers along the longest axis of the centers box
+    BoundingBox centers;
+    centers.min = centers.max = bounds[items[first]].Center();
+    for (int i = first + 1; i < first + count; i++)
+    {
+        BoundingBox center;
+        center.min = center.max = bounds[items[i]].Center();
+        centers.Expand(center);
+    }
+    double sizeX = centers.max.x - centers.min.x;
+    double sizeY = centers.max.y - centers.min.y;
+    double sizeZ = centers.max.z - centers.min.z;
+    int axis = (sizeX >= sizeY && sizeX >= sizeZ) ? 0 : (sizeY >= sizeZ ? 1 : 2);
+
+    int half = count / 2;
+    std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count, [this, axis](int a, int b)
+    {
+        Vector3d centerA = bounds[a].Center();
+        Vector3d centerB = bounds[b].Center();
+        if (axis == 0) return centerA.x < centerB.x;
+        if (axis == 1) return centerA.y < centerB.y;
+        return centerA.z < centerB.z;
+    });
+
+    // The children are created after this node, so the vector can grow while building them
+    int left = BuildNode(first, half, node);
+    int right = BuildNode(first + half, count - half, node);
+    nodes[node].left = left;
+    nodes[node].right = right;
+    nodes[node].bounds = nodes[left].bounds;
+    nodes[node].bounds.Expand(nodes[right].bounds);
+    return node;
+}
+
+void BVH::UpdateLeafBounds(int node)
+{
+    BVHNode& leaf = nodes[node];
+    leaf.bounds = bounds[items[leaf.first]];
+    for (int i = leaf.first + 1; i < leaf.first + leaf.count; i++)
+    {
+        leaf.bounds.Expand(bounds[items[i]]);
+    }
+}
+
+void BVH::Refit(int item, const BoundingBox& itemBounds)
+{
+    bounds[item] = itemBounds;
+    int node = itemLeaves[item];
+    UpdateLeafBounds(node);
+
+    // Walk up to the root while the boxes keep changing
+    for (node = nodes[node].parent; node != -1; node = nodes[node].parent)
+    {
+        BoundingBox refitted = nodes[nodes[node].left].bounds;
+        refitted.Expand(nodes[nodes[node].right].bounds);
+        if (refitted == nodes[node].bounds) break;
+        nodes[node].bounds = refitted;
+    }
+}
+
+int BVH::GetItemCount() const
+{
+    return static_cast<int>(bounds.size());
+}
+
+void BVH::AddItems(int node, std::vector<int>& output) const
+{
+    // The items of a subtree are contiguous in the item list
+    output.insert(output.end(), items.begin() + nodes[node].first, items.begin() + nodes[node].first + nodes[node].count);
+}
+
+void BVH::Cull(const Plane* planes, int planeCount, const Vector3d& origin, std::vector<int>& insideItems, std::vector<int>& intersectingItems) const
+{
+    if (nodes.empty()) return;
+
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        int node = stack.back();
+        stack.pop_back();
+
+        // Box relative to the origin so it fits in float, as center and half size
+        const BoundingBox& box = nodes[node].bounds;
+        Vector3 center = box.Center() - origin;
+        Vector3 extents((box.max.x - box.min.x) * 0.5, (box.max.y - box.min.y) * 0.5, (box.max.z - box.min.z) * 0.5);
+
+        bool inside = true;
+        bool outside = false;
+        for (int i = 0; i < planeCount; i++)
+        {
+            // Distance of the center and the biggest distance of the box to it along the normal
+            float distance = planes[i].Distance(center);
+            float radius = fabsf(planes[i].normal.x) * extents.x + fabsf(planes[i].normal.y) * extents.y + fabsf(planes[i].normal.z) * extents.z;
+            if (distance + radius <= 0)
+            {
+                outside = true;
+                break;
+            }
+            if (distance - radius <= 0) inside = false;
+        }
+        if (outside) continue;
+
+        if (inside)
+        {
+            AddItems(node, insideItems);
+        }
+        else if (nodes[node].left == -1)
+        {
+            AddItems(node, intersectingItems);
+        }
+        else
+        {
+            stack.push_back(nodes[node].right);
+            stack.push_back(nodes[node].left);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "vector.h"
+#include "clipping.h"
+
+// Axis aligned box in world space, in double precision like the world positions
+class BoundingBox
+{
+public:
+    Vector3d min{ 0, 0, 0 };
+    Vector3d max{ 0, 0, 0 };
+
+    void Expand(const BoundingBox& box);
+    Vector3d Center() const;
+    bool operator==(const BoundingBox& box) const;
+};
+
+class BVHNode
+{
+public:
+    BoundingBox bounds;
+    int parent{ -1 };
+    int left{ -1 };     // Inner nodes: both children, leaves have -1
+    int right{ -1 };
+    int first{ 0 };     // Range of the items of the subtree in the item list
+    int count{ 0 };
+};
+
+// Bounding volume hierarchy over the mesh instances of the scene
+// Built once when the scene changes and refitted from the leaf to the root when an instance moves
+class BVH
+{
+public:
+    static const int MaxLeafItems = 4;
+
+    void Build(const std::vector<BoundingBox>& itemBounds);
+    void Refit(int item, const BoundingBox& bounds);
+    int GetItemCount() const;
+
+    // Planes in world space relative to the origin (the camera), with the inside where the distance is positive
+    // The items of the nodes fully inside don't need more tests, the intersecting ones may be outside
+    void Cull(const Plane* planes, int planeCount, const Vector3d& origin, std::vector<int>& insideItems, std::vector<int>& intersectingItems) const;
+
+private:
+    std::vector<BVHNode> nodes;
+    std::vector<int> items;             // Item indices ordered by leaf
+    std::vector<int> itemLeaves;        // Leaf node of every item
+    std::vector<BoundingBox> bounds;    // Bounds of every item
+    mutable std::vector<int> stack;
+
+    int BuildNode(int first, int count, int parent);
+    void UpdateLeafBounds(int node);
+    void AddItems(int node, std::vector<int>& output) const;
+};
+
+#endif
@@ -6,14 +6,20 @@
 
 class Camera {
 public:
-    Vector3 position{ 0, 0, 0 };
+    Vector3d position{ 0, 0, 0 };
     Vector3 direction{ 0, 0, 0 };
     Vector3 forwardVelocity{ 0, 0, 0 };
     Vector3 sideVelocity{ 0, 0, 0 };
     Vector3 verticalVelocity{ 0, 0, 0 };
     float yawPitch[2]{ 0,0 };
 
-    Vector3 GetTarget()
+    Vector3d GetTarget()
+    {
+        // Offset the camera position in the direction where the camera is pointint at
+        return position + GetDirection();
+    }
+
+    Vector3 GetDirection()
     {
         //// LOOKAT CAMERA VIEW MATRIX WITH HARDCODED TARGET
         // Vector3 target = { window->modelTranslation[0], window->modelTranslation[1], window->modelTranslation[2] };
@@ -27,10 +33,8 @@ public:
         Matrix4 cameraYawRotationMatrix = Matrix4::RotationYMatrix(yawPitch[0]);
         Matrix4 cameraPitchRotationMatrix = Matrix4::RotationXMatrix(yawPitch[1]);
         direction = target * cameraPitchRotationMatrix * cameraYawRotationMatrix;
-        // Offset the camera position in the direction where the camera is pointint at
-        target = position + direction;
-        
-        return target;
+
+        return direction;
     }
 };
 
@@ -4,6 +4,7 @@
 #include <vector>
 #include <math.h>
 #include "vector.h"
+#include "framearena.h"
 #include "triangle.h"
 
 class Plane
@@ -11,6 +12,12 @@ class Plane
 public:
     Vector3 point;
     Vector3 normal;
+
+    // Distancia con signo de un punto al plano, positiva en el lado interior
+    float Distance(Vector3 vertex) const
+    {
+        return (vertex - point).DotProduct(normal);
+    }
 };
 
 class Frustum
@@ -53,57 +60,112 @@ public:
     }
 };
 
+// Bits de los outcodes de un vrtice en el espacio de recorte homogneo
+// Los planos de la banda de guarda y near/far son los nicos que se recortan, el resto lo hace el scissor del rasterizador
+class ClipSpace
+{
+public:
+    static const int GuardLeft = 1;
+    static const int GuardRight = 2;
+    static const int GuardBottom = 4;
+    static const int GuardTop = 8;
+    static const int Near = 16;
+    static const int Far = 32;
+    static const int ViewportLeft = 64;
+    static const int ViewportRight = 128;
+    static const int ViewportBottom = 256;
+    static const int ViewportTop = 512;
+
+    // Planos que necesitan recorte y planos que sirven para descartar (fuera de la pantalla o de near/far)
+    static const int ClipPlanes = GuardLeft | GuardRight | GuardBottom | GuardTop | Near | Far;
+    static const int RejectPlanes = Near | Far | ViewportLeft | ViewportRight | ViewportBottom | ViewportTop;
+
+    // La banda de guarda es el factor sobre w que puede salirse un vrtice en x e y sin recortarlo
+    static int ComputeOutcode(float x, float y, float z, float w, float guardBand)
+    {
+        int outcode = 0;
+        float guardW = guardBand * w;
+        if (!(x + guardW > 0)) outcode |= GuardLeft;
+        if (!(guardW - x > 0)) outcode |= GuardRight;
+        if (!(y + guardW > 0)) outcode |= GuardBottom;
+        if (!(guardW - y > 0)) outcode |= GuardTop;
+        if (!(z > 0)) outcode |= Near;
+        if (!(w - z > 0)) outcode |= Far;
+        if (!(x + w > 0)) outcode |= ViewportLeft;
+        if (!(w - x > 0)) outcode |= ViewportRight;
+        if (!(y + w > 0)) outcode |= ViewportBottom;
+        if (!(w - y > 0)) outcode |= ViewportTop;
+        return outcode;
+    }
+
+    // Distancia con signo al plano de recorte, positiva en el lado interior
+    static float Distance(int plane, const Vector4& vertex, float guardBand)
+    {
+        switch (plane)
+        {
+        case GuardLeft: return vertex.x + guardBand * vertex.w;
+        case GuardRight: return guardBand * vertex.w - vertex.x;
+        case GuardBottom: return vertex.y + guardBand * vertex.w;
+        case GuardTop: return guardBand * vertex.w - vertex.y;
+        case Near: return vertex.z;
+        default: return vertex.w - vertex.z;
+        }
+    }
+};
+
+// Polgono en el espacio de recorte homogneo, despus de la matriz de proyeccin y antes de la divisin por w
 class Polygon
 {
 public:
-    std::vector<Vector3> vertices;
-    std::vector<Texture2> textureUVCoords;
+    // Un tringulo recortado por 6 planos gana como mucho un vrtice por plano
+    static const int MaxVertices = 9;
+
+    Vector4 vertices[MaxVertices];
+    Texture2 textureUVCoords[MaxVertices];
+    int vertexCount{ 0 };
 
-    Polygon(Triangle triangle)
+    Polygon(const Vector4* triangleVertices, const Texture2* triangleUVCoords)
     {
-        // Save the starting triangle vertices
-        vertices.push_back(triangle.vertices[0]);
-        vertices.push_back(triangle.vertices[1]);
-        vertices.push_back(triangle.vertices[2]);
-
-        // Save the starting triangle UV Coords
-        textureUVCoords.push_back(triangle.textureUVCoords[0]);
-        textureUVCoords.push_back(triangle.textureUVCoords[1]);
-        textureUVCoords.push_back(triangle.textureUVCoords[2]);
+        // Save the starting triangle vertices and UV Coords
+        for (int i = 0; i < 3; i++)
+        {
+            vertices[i] = triangleVertices[i];
+            textureUVCoords[i] = triangleUVCoords[i];
+        }
+        vertexCount = 3;
     }
 
-    void Clip(Frustum viewFrustum)
+    // Recorta slo contra los planos indicados por el outcode combinado de los vrtices
+    void Clip(int outcode, float guardBand)
     {
-        ClipAgainstPlane(viewFrustum.leftPlane);
-        ClipAgainstPlane(viewFrustum.rightPlane);
-        ClipAgainstPlane(viewFrustum.topPlane);
-        ClipAgainstPlane(viewFrustum.bottomPlane);
-        ClipAgainstPlane(viewFrustum.nearPlane);
-        ClipAgainstPlane(viewFrustum.farPlane);
+        // Con un vrtice detrs de near los nuevos puntos pueden salir de la banda, as que se recorta contra todo
+        if (outcode & ClipSpace::Near) outcode = ClipSpace::ClipPlanes;
+
+        // Primero near para que el resto de planos trabaje siempre con w positiva
+        const int planes[] = { ClipSpace::Near, ClipSpace::Far, ClipSpace::GuardLeft, ClipSpace::GuardRight, ClipSpace::GuardBottom, ClipSpace::GuardTop };
+        for (int plane : planes)
+        {
+            if (outcode & plane) ClipAgainstPlane(plane, guardBand);
+        }
     }
 
-    void GenerateClippedTriangles(std::vector<Triangle>& clippedTriangles)
+    // Los tringulos guardan los vrtices en el espacio de recorte, falta la divisin por w
+    void GenerateClippedTriangles(ArenaVector<Triangle>& clippedTriangles)
     {
         // Ensure a minimum of 3 vertices to create a new triangle
-        if (vertices.size() >= 3)
+        if (vertexCount >= 3)
         {
-            for (size_t i = 0; i < vertices.size() - 2; i++)
+            for (int i = 0; i < vertexCount - 2; i++)
             {
                 int index0 = 0;
                 int index1 = i + 1;
                 int index2 = i + 2;
 
-                Triangle clippedTriangle = Triangle(0xFFFFFFFF);
-
-                // Set the vertices
-                clippedTriangle.vertices[0] = vertices[index0];
-                clippedTriangle.vertices[1] = vertices[index1];
-                clippedTriangle.vertices[2] = vertices[index2];
-
-                // Set the texture UV coords
-                clippedTriangle.textureUVCoords[0] = textureUVCoords[index0];
-                clippedTriangle.textureUVCoords[1] = textureUVCoords[index1];
-                clippedTriangle.textureUVCoords[2] = textureUVCoords[index2];
+                // Set the vertices with their texture UV coords
+                Triangle clippedTriangle;
+                clippedTriangle.vertices[0] = RasterVertex(vertices[index0], textureUVCoords[index0]);
+                clippedTriangle.vertices[1] = RasterVertex(vertices[index1], textureUVCoords[index1]);
+                clippedTriangle.vertices[2] = RasterVertex(vertices[index2], textureUVCoords[index2]);
 
                 clippedTriangles.push_back(clippedTriangle);
             }
@@ -116,46 +178,48 @@ private:
         return a + f * (b - a);
     }
 
-    void ClipAgainstPlane(Plane plane)
+    void ClipAgainstPlane(int plane, float guardBand)
     {
-        // Creamos una cola para almacenar los vrtices dentro del plano
-        std::vector<Vector3> insideVertices;
-        // Creamos una cola para almacenar las coordenadas UV de las tetxturas dentro del plano
-        std::vector<Texture2> insideTextureUVCoords;
+        // Creamos un array en la pila para almacenar los vrtices dentro del plano
+        Vector4 insideVertices[MaxVertices];
+        // Creamos un array para almacenar las coordenadas UV de las tetxturas dentro del plano
+        Texture2 insideTextureUVCoords[MaxVertices];
+        int insideCount = 0;
 
         // Recorremos todos los vrtices
-        for (size_t i = 0; i < vertices.size(); i++)
+        for (int i = 0; i < vertexCount; i++)
         {
             // Recuperamos el vrtice actual y el anterior
-            Vector3 currentVertex = vertices[i];
+            Vector4 currentVertex = vertices[i];
             // Si recin empezamos (i==0) el anterior ser el ltimo
-            Vector3 previousVertex = (i > 0) ? vertices[i - 1] : vertices[vertices.size() - 1];
+            Vector4 previousVertex = (i > 0) ? vertices[i - 1] : vertices[vertexCount - 1];
 
             // Recuperamos las coordenadas UV actuales y anteriores
             Texture2 curTexUVCoords = textureUVCoords[i];
             // Si recin empezamos (i==0) el anterior ser el ltimo
-            Texture2 prevTexUVCoords = (i > 0) ? textureUVCoords[i - 1] : textureUVCoords[textureUVCoords.size() - 1];
+            Texture2 prevTexUVCoords = (i > 0) ? textureUVCoords[i - 1] : textureUVCoords[vertexCount - 1];
 
             // Calculamos los productos escalares de ambos (dotQ1 = n(Q1-P))
-            float currentDot = (currentVertex - plane.point).DotProduct(plane.normal);
-            float previousDot = (previousVertex - plane.point).DotProduct(plane.normal);
+            float currentDot = ClipSpace::Distance(plane, currentVertex, guardBand);
+            float previousDot = ClipSpace::Distance(plane, previousVertex, guardBand);
 
             // Si el vrtice est fuera del plano calculamos el punto de interseccin
             // Podemos saberlo si uno es positivo y el otro es negativo, signigicando esto
             // que un punto a pasado a estar de dentro a fuera o viceversa, de fuera a dentro
-            if (currentDot * previousDot < 0)
+            if (currentDot * previousDot < 0 && insideCount < MaxVertices)
             {
                 // Calculamos el factor de interpolacin, t = dotQ1/(dotQ1-dotQ2)
                 float tFactor = previousDot / (previousDot - currentDot);
 
                 // Calculamos el punto de interseccin interpolado, I = Q1 + t(Q2-Q1)
-                Vector3 intersectionPoint;
+                Vector4 intersectionPoint;
                 intersectionPoint.x = FloatLerp(previousVertex.x, currentVertex.x, tFactor);
                 intersectionPoint.y = FloatLerp(previousVertex.y, currentVertex.y, tFactor);
                 intersectionPoint.z = FloatLerp(previousVertex.z, currentVertex.z, tFactor);
+                intersectionPoint.w = FloatLerp(previousVertex.w, currentVertex.w, tFactor);
 
                 // Insertamos el nuevo punto de interseccin a la lista de vrtices internos
-                insideVertices.push_back(intersectionPoint);
+                insideVertices[insideCount] = intersectionPoint;
 
                 // Calculamos las coordenadas de las texturas UV interpoladas
                 Texture2 interpolatedTexUVCoord;
@@ -163,26 +227,28 @@ private:
                 interpolatedTexUVCoord.v = FloatLerp(prevTexUVCoords.v, curTexUVCoords.v, tFactor);
 
                 // Insertamos las nueva coordenadas de la textura interpolada
-                insideTextureUVCoords.push_back(interpolatedTexUVCoord);
+                insideTextureUVCoords[insideCount] = interpolatedTexUVCoord;
+                insideCount++;
             }
 
             // Si el vrtice se encuentra dentro del plano
-            if (currentDot > 0)
+            if (currentDot > 0 && insideCount < MaxVertices)
             {
-                // Lo aadimos a la cola
-                insideVertices.push_back(currentVertex);
+                // Lo aadimos al array
+                insideVertices[insideCount] = currentVertex;
                 // Y tambin aadimos la textura
-                insideTextureUVCoords.push_back(curTexUVCoords);
+                insideTextureUVCoords[insideCount] = curTexUVCoords;
+                insideCount++;
             }
         }
 
-        // Copiamos los vrtices dentro del plano a los actuales
-        vertices.clear();
-        vertices = insideVertices;
-
-        // Copiamos las coordenadas de las texturas UV dentro del plano a las actuales
-        textureUVCoords.clear();
-        textureUVCoords = insideTextureUVCoords;
+        // Copiamos los vrtices y las coordenadas de las texturas UV dentro del plano a los actuales
+        for (int i = 0; i < insideCount; i++)
+        {
+            vertices[i] = insideVertices[i];
+            textureUVCoords[i] = insideTextureUVCoords[i];
+        }
+        vertexCount = insideCount;
     }
 };
 
@@ -0,0 +1,87 @@
+#ifndef COLORBUFFER_H
+#define COLORBUFFER_H
+
+#include <SDL.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Frame of the rasterizer with the streaming texture where it's presented
+// The SDL calls are only made from the main thread, the render thread only writes the pixels
+class ColorBuffer
+{
+public:
+    enum class State { Free, Rendering, Ready, Displayed };
+
+    SDL_Texture* texture{ nullptr };
+    uint32_t* ownPixels{ nullptr };     // Used when the texture can't be rendered in place
+    uint32_t* pixels{ nullptr };        // Where the current frame is rendered
+    State state{ State::Free };
+
+    ColorBuffer() = default;
+    ColorBuffer(const ColorBuffer&) = delete;
+    ColorBuffer& operator=(const ColorBuffer&) = delete;
+
+    ~ColorBuffer()
+    {
+        free(ownPixels);
+    }
+
+    // The colors are 0xAARRGGBB integers, the same layout as ARGB8888 in any byte order
+    void Create(SDL_Renderer* renderer, int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        ownPixels = static_cast<uint32_t*>(malloc(sizeof(uint32_t) * width * height));
+        pixels = ownPixels;
+        CreateTexture(renderer);
+    }
+
+    // Also used to replace the texture when the render device is reset and the old one is lost
+    void CreateTexture(SDL_Renderer* renderer)
+    {
+        if (texture != nullptr) SDL_DestroyTexture(texture);
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    }
+
+    // Render straight in the memory of the texture when its rows are as long as ours, else in our own pixels
+    void Lock()
+    {
+        pixels = ownPixels;
+        if (SDL_LockTexture(texture, NULL, &lockedPixels, &lockedPitch) != 0)
+        {
+            lockedPixels = nullptr;
+            return;
+        }
+        if (lockedPitch == width * static_cast<int>(sizeof(uint32_t)))
+            pixels = static_cast<uint32_t*>(lockedPixels);
+    }
+
+    // Give the frame to the texture, only copying it when it wasn't rendered in place
+    void Unlock()
+    {
+        if (lockedPixels == nullptr)
+        {
+            SDL_UpdateTexture(texture, NULL, pixels, width * sizeof(uint32_t));
+            return;
+        }
+
+        if (pixels != lockedPixels)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                memcpy(static_cast<char*>(lockedPixels) + lockedPitch * y, pixels + width * y, width * sizeof(uint32_t));
+            }
+        }
+        SDL_UnlockTexture(texture);
+        lockedPixels = nullptr;
+    }
+
+private:
+    int width{ 0 };
+    int height{ 0 };
+    void* lockedPixels{ nullptr };
+    int lockedPitch{ 0 };
+};
+
+#endif
@@ -1 +1,456 @@
 #include "engine.h"
+#include "window.h"
+#include <algorithm>
+
+void RenderEngine::Update()
+{
+	frameStartHeapAllocations = GetHeapAllocationCount();
+
+	// The geometry started in the previous frame is the one to rasterize now
+	if (geometryPending)
+	{
+		geometryThread.Wait();
+		geometryPending = false;
+		UseNextGeometry();
+	}
+
+	// Same view and no dirty instances since the last geometry: it's the same frame again, nothing to build
+	// Checked before touching the arenas and the instances, so a static frame does almost nothing
+	FrameGeometry& frame = frames[geometryFrame];
+	CaptureView(frame.view);
+	frame.viewChanged = !hasGeometry || !frame.view.IsSameView(frames[renderFrame].view);
+	if (!frame.viewChanged && !HaveDirtyInstances())
+	{
+		staticFrameCount++;
+		frameHeapAllocationCount = static_cast<int>(GetHeapAllocationCount() - frameStartHeapAllocations);
+		return;
+	}
+
+	BeginGeometryStage();
+
+	if (window->pipelineFrames)
+	{
+		// Build this frame in the background while the previous one is rasterized, it's drawn one frame later
+		geometryThread.Start(geometryTask);
+		geometryPending = true;
+	}
+	else
+	{
+		RunGeometryStage();
+		UseNextGeometry();
+	}
+}
+
+void RenderEngine::BeginGeometryStage()
+{
+	// Nothing reads the frame being built, its triangles and streams were already rasterized
+	FrameGeometry& frame = frames[geometryFrame];
+	geometryPool.SetThreadCount(geometryThreadCount);
+	frame.arena.Reset();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].BeginFrame(frame.arena);
+	}
+	while (frame.threadArenas.size() < static_cast<size_t>(geometryPool.GetThreadCount()))
+	{
+		frame.threadArenas.push_back(std::unique_ptr<FrameArena>(new FrameArena()));
+	}
+	for (size_t i = 0; i < frame.threadArenas.size(); i++)
+	{
+		frame.threadArenas[i]->Reset();
+	}
+}
+
+void RenderEngine::CaptureView(FrameView& view)
+{
+	// Calculate the view matrix only when the camera turns, relative to the camera so it sits at the origin
+	const float* yawPitch = window->camera.yawPitch;
+	if (!viewMatrixValid || yawPitch[0] != viewYawPitch[0] || yawPitch[1] != viewYawPitch[1])
+	{
+		window->viewMatrix = Matrix4::LookAt(
+			{ 0, 0, 0 }, window->camera.GetDirection(), { 0, 1, 0 });  // Vector3 upDirection
+		viewYawPitch[0] = yawPitch[0];
+		viewYawPitch[1] = yawPitch[1];
+		viewMatrixValid = true;
+	}
+
+	// Copy everything the geometry stage reads from the window, it may change before the stage is finished
+	view.cameraPosition = window->camera.position;
+	view.viewMatrix = window->viewMatrix;
+	view.projectionMatrix = window->projectionMatrix;
+	view.viewFrustum = window->viewFrustum;
+	view.lightDirection = window->light.direction;
+	view.guardBand = window->guardBand;
+	view.rendererWidth = window->rendererWidth;
+	view.rendererHeight = window->rendererHeight;
+	view.enableBackfaceCulling = window->enableBackfaceCulling;
+	view.enableFrustumCulling = window->enableFrustumCulling;
+	view.enableMeshletCulling = window->enableMeshletCulling;
+	view.enableLOD = window->enableLOD;
+	view.lodScreenRadius = window->lodScreenRadius;
+	view.drawTriangleNormals = window->drawTriangleNormals;
+}
+
+void RenderEngine::RunGeometryStage()
+{
+	// Only reads the view of the frame and the copies of the instances, everything it writes belongs to the frame
+	FrameGeometry& frame = frames[geometryFrame];
+	const FrameView& view = frame.view;
+
+	UpdateSceneBVH();
+	CullInstances(frame);
+
+	frame.faceCount = 0;
+	frame.fullDetailFaceCount = 0;
+	for (size_t i = 0; i < visibleInstances.size(); i++)
+	{
+		const MeshInstanceRef& ref = instanceRefs[visibleInstances[i]];
+		Mesh& mesh = meshes[ref.mesh];
+		SelectLOD(mesh, ref.instance, view);
+		frame.faceCount += mesh.GetFaceCount(mesh.GetLOD(ref.instance));
+		frame.fullDetailFaceCount += mesh.GetFaceCount(0);
+	}
+
+	// Split the visible instances in batches of meshlets and run their geometry stage in all the threads
+	// With the same view the meshes whose instances haven't moved keep the triangles of the previous geometry
+	geometryBatches.clear();
+	frame.reusedMeshCount = 0;
+	for (size_t i = 0; i < frame.visibleMeshes.size(); i++)
+	{
+		Mesh& mesh = meshes[frame.visibleMeshes[i]];
+		if (!frame.viewChanged && !mesh.HaveInstancesChanged())
+		{
+			mesh.ReuseTriangles();
+			frame.reusedMeshCount++;
+		}
+		else
+			mesh.AddGeometryBatches(frame.visibleMeshes[i], geometryBatches);
+	}
+	geometryPool.ParallelFor(static_cast<int>(geometryBatches.size()), [this, &frame](int i)
+	{
+		GeometryBatch& batch = geometryBatches[i];
+		meshes[batch.mesh].RunGeometryBatch(batch, frame.view, *frame.threadArenas[ThreadPool::GetThreadIndex()]);
+	});
+
+	// Join the triangles of the batches in their order, so the meshes get the same list as with a single thread
+	for (size_t i = 0; i < geometryBatches.size(); i++)
+	{
+		meshes[geometryBatches[i].mesh].AddBatchTriangles(geometryBatches[i]);
+	}
+
+	frame.meshletCount = 0;
+	frame.culledMeshletCount = 0;
+	for (size_t i = 0; i < frame.visibleMeshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[frame.visibleMeshes[i]];
+		frame.meshletCount += mesh.GetNextMeshletCount();
+		frame.culledMeshletCount += mesh.GetNextCulledMeshletCount();
+	}
+}
+
+void RenderEngine::UseNextGeometry()
+{
+	// The frame just built goes to the rasterizer and the other one is free for the next geometry stage
+	std::swap(geometryFrame, renderFrame);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].UseNextTriangles();
+	}
+	hasGeometry = true;
+	hasNewGeometry = true;
+}
+
+bool RenderEngine::HaveDirtyInstances()
+{
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].HasDirtyInstances()) return true;
+	}
+	return false;
+}
+
+void RenderEngine::UpdateSceneBVH()
+{
+	size_t instanceCount = 0;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		instanceCount += meshes[i].GetFrameInstanceCount();
+	}
+
+	// Build the whole tree when the instances change, else only refit the instances that have moved
+	if (instanceRefs.size() != instanceCount || sceneBVH.GetItemCount() != static_cast<int>(instanceCount))
+	{
+		instanceRefs.clear();
+		instanceBounds.clear();
+		meshFirstRefs.clear();
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			meshFirstRefs.push_back(static_cast<int>(instanceRefs.size()));
+			for (int j = 0; j < meshes[i].GetFrameInstanceCount(); j++)
+			{
+				MeshInstanceRef ref;
+				ref.mesh = static_cast<int>(i);
+				ref.instance = j;
+				instanceRefs.push_back(ref);
+				meshes[i].UpdateWorldBounds(j);
+				instanceBounds.push_back(meshes[i].GetWorldBounds(j));
+			}
+		}
+		sceneBVH.Build(instanceBounds);
+		return;
+	}
+
+	// The meshes know which instances were set since the last frame, the cost doesn't grow with the static ones
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const std::vector<int>& changedInstances = meshes[i].GetChangedInstances();
+		for (int instance : changedInstances)
+		{
+			meshes[i].UpdateWorldBounds(instance);
+			sceneBVH.Refit(meshFirstRefs[i] + instance, meshes[i].GetWorldBounds(instance));
+		}
+	}
+}
+
+void RenderEngine::CullInstances(FrameGeometry& frame)
+{
+	const FrameView& view = frame.view;
+	visibleInstances.clear();
+
+	if (!view.enableFrustumCulling)
+	{
+		for (size_t i = 0; i < instanceRefs.size(); i++)
+		{
+			visibleInstances.push_back(static_cast<int>(i));
+			meshes[instanceRefs[i].mesh].UpdateModelViewMatrix(instanceRefs[i].instance, view);
+		}
+	}
+	else
+	{
+		// Rotate the view space planes to the world axes, the view matrix is only a rotation because the camera is the origin
+		const Matrix4& viewMatrix = view.viewMatrix;
+		const Plane* viewPlanes[] = { &view.viewFrustum.leftPlane, &view.viewFrustum.rightPlane, &view.viewFrustum.topPlane,
+			&view.viewFrustum.bottomPlane, &view.viewFrustum.nearPlane, &view.viewFrustum.farPlane };
+		Plane worldPlanes[6];
+		for (int i = 0; i < 6; i++)
+		{
+			Vector3 point = viewPlanes[i]->point;
+			Vector3 normal = viewPlanes[i]->normal;
+			worldPlanes[i].point = Vector3(
+				viewMatrix.m[0][0] * point.x + viewMatrix.m[1][0] * point.y + viewMatrix.m[2][0] * point.z,
+				viewMatrix.m[0][1] * point.x + viewMatrix.m[1][1] * point.y + viewMatrix.m[2][1] * point.z,
+				viewMatrix.m[0][2] * point.x + viewMatrix.m[1][2] * point.y + viewMatrix.m[2][2] * point.z);
+			worldPlanes[i].normal = Vector3(
+				viewMatrix.m[0][0] * normal.x + viewMatrix.m[1][0] * normal.y + viewMatrix.m[2][0] * normal.z,
+				viewMatrix.m[0][1] * normal.x + viewMatrix.m[1][1] * normal.y + viewMatrix.m[2][1] * normal.z,
+				viewMatrix.m[0][2] * normal.x + viewMatrix.m[1][2] * normal.y + viewMatrix.m[2][2] * normal.z);
+		}
+
+		insideInstances.clear();
+		intersectingInstances.clear();
+		sceneBVH.Cull(worldPlanes, 6, view.cameraPosition, insideInstances, intersectingInstances);
+
+		// The instances of the nodes fully inside are visible, the others still test their own bounding volumes
+		// Their model view matrix is calculated here once, the culling, the LOD and the geometry stage use it
+		visibleInstances.insert(visibleInstances.end(), insideInstances.begin(), insideInstances.end());
+		for (size_t i = 0; i < insideInstances.size(); i++)
+		{
+			const MeshInstanceRef& ref = instanceRefs[insideInstances[i]];
+			meshes[ref.mesh].UpdateModelViewMatrix(ref.instance, view);
+		}
+		for (size_t i = 0; i < intersectingInstances.size(); i++)
+		{
+			const MeshInstanceRef& ref = instanceRefs[intersectingInstances[i]];
+			meshes[ref.mesh].UpdateModelViewMatrix(ref.instance, view);
+			if (!meshes[ref.mesh].IsOutsideFrustum(ref.instance, view))
+				visibleInstances.push_back(intersectingInstances[i]);
+		}
+
+		// Keep the order of the instances so the result doesn't depend on the tree
+		std::sort(visibleInstances.begin(), visibleInstances.end());
+	}
+	frame.instanceCount = static_cast<int>(instanceRefs.size());
+	frame.culledInstanceCount = static_cast<int>(instanceRefs.size() - visibleInstances.size());
+
+	// Give every mesh its visible instances, the meshes without any are skipped
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		meshes[i].ClearVisibleInstances();
+	}
+	for (size_t i = 0; i < visibleInstances.size(); i++)
+	{
+		const MeshInstanceRef& ref = instanceRefs[visibleInstances[i]];
+		meshes[ref.mesh].AddVisibleInstance(ref.instance);
+	}
+	frame.visibleMeshes.clear();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].HasVisibleInstances()) frame.visibleMeshes.push_back(static_cast<int>(i));
+	}
+}
+
+int RenderEngine::GetLODForScreenRadius(const Mesh& mesh, float screenRadius, const FrameView& view)
+{
+	// Every level has half the faces, so it goes down a level each time the projected area is halved
+	if (screenRadius >= view.lodScreenRadius) return 0;
+	if (screenRadius <= 0) return mesh.GetLODCount() - 1;
+	float areaRatio = view.lodScreenRadius / screenRadius;
+	int level = static_cast<int>(log2f(areaRatio * areaRatio));
+	return std::min(level, mesh.GetLODCount() - 1);
+}
+
+void RenderEngine::SelectLOD(Mesh& mesh, int instance, const FrameView& view)
+{
+	if (!view.enableLOD || mesh.GetLODCount() <= 1)
+	{
+		mesh.SetLOD(instance, 0);
+		return;
+	}
+
+	// Only go to a coarser level when the mesh is a bit smaller than the limit, and to a finer one when it's a bit bigger
+	float screenRadius = mesh.GetScreenRadius(instance, view);
+	int coarserLevel = GetLODForScreenRadius(mesh, screenRadius * (1 + LODHysteresis), view);
+	int finerLevel = GetLODForScreenRadius(mesh, screenRadius * (1 - LODHysteresis), view);
+	int level = mesh.GetLOD(instance);
+	if (level < coarserLevel) level = coarserLevel;
+	else if (level > finerLevel) level = finerLevel;
+	mesh.SetLOD(instance, level);
+}
+
+void RenderEngine::Render()
+{
+	RenderMeshes();
+	hasNewGeometry = false;
+
+	// Once the scene stops growing the frames shouldn't touch the heap
+	frameHeapAllocationCount = static_cast<int>(GetHeapAllocationCount() - frameStartHeapAllocations);
+}
+
+void RenderEngine::RenderMeshes()
+{
+	const std::vector<int>& visibleMeshes = frames[renderFrame].visibleMeshes;
+	bool visibilityPass = window->enableVisibilityBuffer && (window->drawFilledTriangles || window->drawTexturedTriangles);
+
+	// With a single thread render the meshes in order as always
+	if (threadPool.GetThreadCount() <= 1 && !visibilityPass)
+	{
+		for (size_t i = 0; i < visibleMeshes.size(); i++)
+		{
+			meshes[visibleMeshes[i]].Render();
+		}
+		return;
+	}
+
+	// Binning: assign every projected triangle to the screen tiles it overlaps
+	// The triangle references keep the position of the mesh in the visible list
+	tileBinner.Resize(window->rendererWidth, window->rendererHeight);
+	tileBinner.Clear();
+	for (size_t i = 0; i < visibleMeshes.size(); i++)
+	{
+		meshes[visibleMeshes[i]].BinTriangles(static_cast<int>(i), tileBinner);
+	}
+
+	if (visibilityPass)
+	{
+		// The id of a triangle is the first id of its mesh plus its index, in the order of the meshes
+		visibilityBaseIds.resize(visibleMeshes.size());
+		uint32_t nextId = 0;
+		for (size_t i = 0; i < visibleMeshes.size(); i++)
+		{
+			visibilityBaseIds[i] = nextId;
+			nextId += static_cast<uint32_t>(meshes[visibleMeshes[i]].GetTriangleCount());
+		}
+
+		// Rasterize the ids and resolve the shading of each tile while its pixels are still in cache
+		threadPool.ParallelFor(tileBinner.GetTileCount(), [this](int tile)
+		{
+			RenderVisibilityTile(tile);
+		});
+	}
+	else
+	{
+		// Rasterize the tiles in parallel, each thread only writes the pixels of its own tile
+		// The triangles of a bin keep the submission order so the result is the same as the serial one
+		threadPool.ParallelFor(tileBinner.GetTileCount(), [this, &visibleMeshes](int tile)
+		{
+			ScreenRect clip = tileBinner.GetTileRect(tile);
+			const std::vector<TriangleRef>& bin = tileBinner.GetBin(tile);
+			for (size_t i = 0; i < bin.size(); i++)
+			{
+				meshes[visibleMeshes[bin[i].mesh]].RenderTriangle(bin[i].triangle, clip);
+			}
+		});
+	}
+
+	// The debugging overlays are drawn after the triangles in the main thread
+	for (size_t i = 0; i < visibleMeshes.size(); i++)
+	{
+		meshes[visibleMeshes[i]].RenderOverlays();
+	}
+}
+
+void RenderEngine::RenderVisibilityTile(int tile)
+{
+	ScreenRect clip = tileBinner.GetTileRect(tile);
+	const std::vector<int>& visibleMeshes = frames[renderFrame].visibleMeshes;
+	int width = window->rendererWidth;
+
+	// Clear the ids of the tile
+	for (int y = clip.minY; y <= clip.maxY; y++)
+	{
+		uint32_t* visibilityRow = window->visibilityBuffer + width * y;
+		for (int x = clip.minX; x <= clip.maxX; x++)
+		{
+			visibilityRow[x] = Window::EmptyVisibility;
+		}
+	}
+
+	// First pass: only depth and triangle ids, the overdrawn pixels don't pay any shading
+	const std::vector<TriangleRef>& bin = tileBinner.GetBin(tile);
+	for (size_t i = 0; i < bin.size(); i++)
+	{
+		uint32_t id = visibilityBaseIds[bin[i].mesh] + bin[i].triangle;
+		meshes[visibleMeshes[bin[i].mesh]].RenderTriangleVisibility(bin[i].triangle, id, clip);
+	}
+
+	// Second pass: shade every visible pixel exactly once
+	TriangleSetup setup;
+	RasterSpan span;
+	uint32_t setupId = Window::EmptyVisibility;
+	bool setupValid = false;
+
+	for (int y = clip.minY; y <= clip.maxY; y++)
+	{
+		const uint32_t* visibilityRow = window->visibilityBuffer + width * y;
+		span.colorRow = window->GetColorBuffer() + width * y;
+
+		for (int x = clip.minX; x <= clip.maxX; x++)
+		{
+			uint32_t id = visibilityRow[x];
+			if (id == Window::EmptyVisibility) continue;
+
+			// Group the neighbour pixels of the same triangle in a single span
+			int xEnd = x;
+			while (xEnd < clip.maxX && visibilityRow[xEnd + 1] == id) xEnd++;
+
+			// Rebuild the triangle setup only when the triangle changes
+			if (id != setupId)
+			{
+				// Find the mesh owning the id, the last one with a first id not greater than it
+				size_t mesh = std::upper_bound(visibilityBaseIds.begin(), visibilityBaseIds.end(), id) - visibilityBaseIds.begin() - 1;
+				setupValid = meshes[visibleMeshes[mesh]].SetupTriangleShading(id - visibilityBaseIds[mesh], setup, span);
+				setupId = id;
+			}
+
+			if (setupValid)
+			{
+				setup.SetupRow(y, span);
+				span.xStart = x;
+				span.xEnd = xEnd;
+				window->shadeKernel(span);
+			}
+
+			x = xEnd;
+		}
+	}
+}
@@ -2,36 +2,230 @@
 #define ENGINE_H
 
 #include <vector>
+#include <utility>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <stdint.h>
 #include "mesh.h"
+#include "threadpool.h"
+#include "tilebinner.h"
+#include "bvh.h"
+#include "framearena.h"
+#include "frameview.h"
+
+// Para prevenir dependencias cíclicas
+class Window;
+
+// Instance of a mesh in the scene
+class MeshInstanceRef
+{
+public:
+	int mesh{ 0 };
+	int instance{ 0 };
+};
+
+// Output of the geometry stage of a frame with the view it was built for
+// There are two of them so the geometry of a frame can be built while the previous one is rasterized
+class FrameGeometry
+{
+public:
+	FrameView view;
+	std::vector<int> visibleMeshes;
+
+	/* Memory of the geometry stage, released at once when the frame begins again */
+	/* The batches write in the arena of their thread and the meshes join their triangles in the one of the frame */
+	FrameArena arena;
+	std::vector<std::unique_ptr<FrameArena>> threadArenas;
+
+	/* Statistics of the frame */
+	int instanceCount{ 0 };
+	int culledInstanceCount{ 0 };
+	size_t faceCount{ 0 };
+	size_t fullDetailFaceCount{ 0 };
+	int meshletCount{ 0 };
+	int culledMeshletCount{ 0 };
+	int reusedMeshCount{ 0 };
+
+	bool viewChanged{ true };	// Different view than the previous geometry, no mesh can reuse its triangles
+};
 
 class RenderEngine
 {
 public:
 
-	void SetMeshes(std::vector<Mesh> meshes)
+	void SetWindow(Window* window)
+	{
+		this->window = window;
+	}
+
+	// The engine owns the meshes, they are moved in and referenced by their index
+	int AddMesh(Mesh&& mesh)
+	{
+		// The geometry stage running in the background can't see the meshes moving
+		geometryThread.Wait();
+		meshes.push_back(std::move(mesh));
+		return static_cast<int>(meshes.size()) - 1;
+	}
+
+	int GetMeshCount()
+	{
+		return static_cast<int>(meshes.size());
+	}
+
+	Mesh& GetMesh(int index)
+	{
+		return meshes[index];
+	}
+
+	// Threads for the whole frame: with the frames pipelined the geometry and the rasterization run at the same time,
+	// so they split them instead of each one taking all the cores
+	// The geometry pool changes with the next frame, it may be running in the background now
+	void SetThreadCount(int threadCount, bool pipelined)
+	{
+		int geometryThreads = pipelined ? std::max(1, threadCount / 2) : threadCount;
+		int rasterThreads = pipelined ? std::max(1, threadCount - geometryThreads) : threadCount;
+		threadPool.SetThreadCount(rasterThreads);
+		geometryThreadCount = geometryThreads;
+	}
+
+	// The statistics are the ones of the frame being rasterized
+	int GetInstanceCount()
+	{
+		return frames[renderFrame].instanceCount;
+	}
+
+	int GetCulledInstanceCount()
+	{
+		return frames[renderFrame].culledInstanceCount;
+	}
+
+	size_t GetFaceCount()
 	{
-		this->meshes = meshes;
+		return frames[renderFrame].faceCount;
 	}
 
-	void Update()
+	size_t GetFullDetailFaceCount()
 	{
-		for (size_t i = 0; i < meshes.size(); i++)
-		{
-			meshes[i].Update();
-		}
+		return frames[renderFrame].fullDetailFaceCount;
 	}
 
-	void Render()
+	int GetMeshletCount()
 	{
-		for (size_t i = 0; i < meshes.size(); i++)
-		{
-			
-			meshes[i].Render();
-		}
+		return frames[renderFrame].meshletCount;
 	}
 
+	int GetCulledMeshletCount()
+	{
+		return frames[renderFrame].culledMeshletCount;
+	}
+
+	int GetReusedMeshCount()
+	{
+		return frames[renderFrame].reusedMeshCount;
+	}
+
+	// Frames where nothing had changed and the geometry stage didn't run
+	int GetStaticFrameCount()
+	{
+		return staticFrameCount;
+	}
+
+	// False when the geometry to rasterize is the same as in the last Render
+	bool HasNewGeometry()
+	{
+		return hasNewGeometry;
+	}
+
+	// Memory of the frame arenas of the engine and the threads
+	size_t GetFrameArenaUsedBytes()
+	{
+		const FrameGeometry& frame = frames[renderFrame];
+		size_t usedBytes = frame.arena.GetUsedBytes();
+		for (size_t i = 0; i < frame.threadArenas.size(); i++) usedBytes += frame.threadArenas[i]->GetUsedBytes();
+		return usedBytes;
+	}
+
+	size_t GetFrameArenaCapacity()
+	{
+		const FrameGeometry& frame = frames[renderFrame];
+		size_t capacity = frame.arena.GetCapacity();
+		for (size_t i = 0; i < frame.threadArenas.size(); i++) capacity += frame.threadArenas[i]->GetCapacity();
+		return capacity;
+	}
+
+	// Heap allocations of the last Update and Render, only the Update in the frames without changes
+	// Only counted in the debug builds
+	int GetFrameHeapAllocationCount()
+	{
+		return frameHeapAllocationCount;
+	}
+
+	void Update();
+	void Render();
+
 private:
+	Window* window{ nullptr };
 	std::vector<Mesh> meshes;
+
+	/* Scene BVH over all the instances of all the meshes, the instances to draw this frame in their order */
+	BVH sceneBVH;
+	std::vector<MeshInstanceRef> instanceRefs;
+	std::vector<int> meshFirstRefs;		// Index of the first instance of every mesh in the tree
+	std::vector<BoundingBox> instanceBounds;
+	std::vector<int> visibleInstances;
+	std::vector<int> insideInstances;
+	std::vector<int> intersectingInstances;
+
+	/* Levels of detail: fraction of the size to go past before changing of level, to not jump back and forth */
+	static constexpr float LODHysteresis = 0.15f;
+
+	/* Geometry stage split in batches of meshlets, run by all the threads of its own pool */
+	std::vector<GeometryBatch> geometryBatches;
+	ThreadPool geometryPool;
+	int geometryThreadCount{ 1 };
+
+	/* Double buffered geometry: the frame being built and the one being rasterized */
+	FrameGeometry frames[2];
+	int geometryFrame{ 0 };
+	int renderFrame{ 1 };
+
+	/* Dirty tracking: without changes in the view or the instances the last geometry and image are still valid */
+	bool hasGeometry{ false };
+	bool hasNewGeometry{ false };
+	int staticFrameCount{ 0 };
+
+	/* Camera angles of the last view matrix, it's only calculated again when they change */
+	float viewYawPitch[2]{ 0, 0 };
+	bool viewMatrixValid{ false };
+
+	/* Tiled rasterization */
+	ThreadPool threadPool;
+	TileBinner tileBinner;
+
+	/* Visibility buffer: first triangle id of every mesh in the current frame */
+	std::vector<uint32_t> visibilityBaseIds;
+
+	size_t frameStartHeapAllocations{ 0 };
+	int frameHeapAllocationCount{ 0 };
+
+	/* Pipelined frames: the geometry of a frame runs in the background while the previous one is rasterized */
+	/* Declared the last so it's stopped before anything it uses is destroyed */
+	std::function<void()> geometryTask{ [this] { RunGeometryStage(); } };
+	bool geometryPending{ false };
+	BackgroundThread geometryThread;
+
+	void CaptureView(FrameView& view);
+	void BeginGeometryStage();
+	void RunGeometryStage();
+	void UseNextGeometry();
+	bool HaveDirtyInstances();
+	void UpdateSceneBVH();
+	void CullInstances(FrameGeometry& frame);
+	int GetLODForScreenRadius(const Mesh& mesh, float screenRadius, const FrameView& view);
+	void SelectLOD(Mesh& mesh, int instance, const FrameView& view);
+	void RenderMeshes();
+	void RenderVisibilityTile(int tile);
 };
 
-#endif
\ No newline at end of file
+#endif
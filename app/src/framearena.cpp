@@ -0,0 +1,100 @@
+#include "framearena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<size_t> heapAllocationCount{ 0 };
+
+#ifdef _DEBUG
+// Count every allocation of the program to check that the frames don't use the heap
+void* operator new(size_t size)
+{
+    heapAllocationCount++;
+    void* pointer = malloc(size > 0 ? size : 1);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+#endif
+
+size_t GetHeapAllocationCount()
+{
+    return heapAllocationCount;
+}
+
+FrameArena::~FrameArena()
+{
+    while (block != nullptr)
+    {
+        Block* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+}
+
+void FrameArena::AddBlock(size_t size)
+{
+    Block* newBlock = static_cast<Block*>(malloc(sizeof(Block) + size));
+    if (newBlock == nullptr) throw std::bad_alloc();
+    newBlock->previous = block;
+    newBlock->size = size;
+    block = newBlock;
+    offset = 0;
+    capacity += size;
+}
+
+static size_t AlignOffset(const char* base, size_t offset, size_t alignment)
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(base) + offset;
+    return offset + (alignment - address % alignment) % alignment;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    // Start a new block when the allocation doesn't fit in the current one
+    size_t start = block != nullptr ? AlignOffset(GetData(), offset, alignment) : 0;
+    if (block == nullptr || start + size > block->size)
+    {
+        AddBlock(std::max(std::max(MinBlockSize, capacity), size + alignment));
+        start = AlignOffset(GetData(), 0, alignment);
+    }
+
+    usedBytes += start + size - offset;
+    offset = start + size;
+    return GetData() + start;
+}
+
+bool FrameArena::Extend(void* pointer, size_t oldSize, size_t newSize)
+{
+    if (block == nullptr || static_cast<char*>(pointer) + oldSize != GetData() + offset) return false;
+    if (offset - oldSize + newSize > block->size) return false;
+
+    usedBytes += newSize - oldSize;
+    offset += newSize - oldSize;
+    return true;
+}
+
+void FrameArena::Reset()
+{
+    // Replace the blocks of a frame that didn't fit in one by a single block with all their space
+    if (block != nullptr && block->previous != nullptr)
+    {
+        size_t size = capacity;
+        while (block != nullptr)
+        {
+            Block* previous = block->previous;
+            free(block);
+            block = previous;
+        }
+        capacity = 0;
+        AddBlock(size);
+    }
+
+    offset = 0;
+    usedBytes = 0;
+}
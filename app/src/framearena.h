@@ -0,0 +1,138 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+
+// Heap allocations done by the whole program since it started, only counted in the debug builds
+size_t GetHeapAllocationCount();
+
+// Bump allocator for the data that only lives during a frame, everything is released at once with Reset
+// When a frame needs more than a block the extra blocks are joined in a bigger one at the next Reset,
+// so once the frames stop growing there are no more heap allocations
+class FrameArena
+{
+public:
+    FrameArena() = default;
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena();
+
+    void* Allocate(size_t size, size_t alignment);
+
+    // Uninitialized memory for count objects, only for types without destructor
+    template <typename T>
+    T* Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "The arena doesn't call destructors");
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Grow the last allocation in place when there is space left in its block
+    bool Extend(void* pointer, size_t oldSize, size_t newSize);
+
+    // Release everything allocated since the last reset, the pointers given before are not valid anymore
+    void Reset();
+
+    // Bytes allocated in the current frame and size of the blocks
+    size_t GetUsedBytes() const
+    {
+        return usedBytes;
+    }
+
+    size_t GetCapacity() const
+    {
+        return capacity;
+    }
+
+private:
+    static const size_t MinBlockSize = 1 << 20;
+
+    // Header at the start of every block, the full blocks of the frame are linked from the current one
+    struct Block
+    {
+        Block* previous;
+        size_t size;
+    };
+
+    Block* block{ nullptr };
+    size_t offset{ 0 };
+    size_t usedBytes{ 0 };
+    size_t capacity{ 0 };
+
+    void AddBlock(size_t size);
+
+    // The data of a block starts after its header
+    char* GetData() const
+    {
+        return reinterpret_cast<char*>(block + 1);
+    }
+};
+
+// Growing array with the memory in a frame arena, with the same interface as std::vector for the parts used by the meshes
+// Only for trivially copyable types, and it has to be created again after the arena is reset
+template <typename T>
+class ArenaVector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "The arena vector copies the items with memcpy");
+
+public:
+    ArenaVector() = default;
+    explicit ArenaVector(FrameArena& arena) : arena(&arena) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T& back() { return items[count - 1]; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+
+    void clear()
+    {
+        count = 0;
+    }
+
+    void push_back(const T& item)
+    {
+        if (count == capacity) Grow(count + 1);
+        items[count++] = item;
+    }
+
+    // The new items are not initialized
+    void resize(size_t size)
+    {
+        if (size > capacity) Grow(size);
+        count = size;
+    }
+
+private:
+    FrameArena* arena{ nullptr };
+    T* items{ nullptr };
+    size_t count{ 0 };
+    size_t capacity{ 0 };
+
+    void Grow(size_t minCapacity)
+    {
+        size_t newCapacity = std::max(std::max(minCapacity, capacity * 2), static_cast<size_t>(16));
+        if (items != nullptr && arena->Extend(items, capacity * sizeof(T), newCapacity * sizeof(T)))
+        {
+            capacity = newCapacity;
+            return;
+        }
+
+        // The old items stay in the arena until the next reset
+        T* newItems = arena->Allocate<T>(newCapacity);
+        if (count > 0) memcpy(newItems, items, count * sizeof(T));
+        items = newItems;
+        capacity = newCapacity;
+    }
+};
+
+#endif
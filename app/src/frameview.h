@@ -0,0 +1,45 @@
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include "vector.h"
+#include "matrix.h"
+#include "clipping.h"
+#include <string.h>
+
+// Camera, projection, light and options read by the geometry stage, copied from the window when a frame begins
+// With the frames pipelined the geometry stage runs in the background while the window goes on changing them
+class FrameView
+{
+public:
+    Vector3d cameraPosition{ 0, 0, 0 };
+    Matrix4 viewMatrix;
+    Matrix4 projectionMatrix;
+    Frustum viewFrustum;
+    Vector3 lightDirection{ 0, 0, 1 };
+    float guardBand{ 4 };
+    int rendererWidth{ 0 };
+    int rendererHeight{ 0 };
+
+    bool enableBackfaceCulling{ true };
+    bool enableFrustumCulling{ true };
+    bool enableMeshletCulling{ true };
+    bool enableLOD{ true };
+    float lodScreenRadius{ 200 };
+    bool drawTriangleNormals{ false };
+
+    // True when the geometry stage would give the same triangles with both views
+    // The frustum is not compared, it comes from the same field of view as the projection matrix
+    bool IsSameView(const FrameView& view) const
+    {
+        return cameraPosition.x == view.cameraPosition.x && cameraPosition.y == view.cameraPosition.y && cameraPosition.z == view.cameraPosition.z &&
+            memcmp(viewMatrix.m, view.viewMatrix.m, sizeof(viewMatrix.m)) == 0 &&
+            memcmp(projectionMatrix.m, view.projectionMatrix.m, sizeof(projectionMatrix.m)) == 0 &&
+            lightDirection.x == view.lightDirection.x && lightDirection.y == view.lightDirection.y && lightDirection.z == view.lightDirection.z &&
+            guardBand == view.guardBand && rendererWidth == view.rendererWidth && rendererHeight == view.rendererHeight &&
+            enableBackfaceCulling == view.enableBackfaceCulling && enableFrustumCulling == view.enableFrustumCulling &&
+            enableMeshletCulling == view.enableMeshletCulling && enableLOD == view.enableLOD &&
+            lodScreenRadius == view.lodScreenRadius && drawTriangleNormals == view.drawTriangleNormals;
+    }
+};
+
+#endif
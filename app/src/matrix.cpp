@@ -0,0 +1,107 @@
+#include "matrix.h"
+
+// Rows of the matrix applied to points stored as structure of arrays, one output stream per row
+// The sums are made in the same order in all the paths, so they give the same results
+static void TransformStreamsScalar(const Matrix4& matrix, const float* x, const float* y, const float* z, float* const* output, int rowCount, size_t start, size_t count)
+{
+    for (int row = 0; row < rowCount; row++)
+    {
+        const float m0 = matrix.m[row][0], m1 = matrix.m[row][1], m2 = matrix.m[row][2], m3 = matrix.m[row][3];
+        float* out = output[row];
+        for (size_t i = start; i < count; i++)
+        {
+            out[i] = m0 * x[i] + m1 * y[i] + m2 * z[i] + m3;
+        }
+    }
+}
+
+#if defined(SIMD_X86)
+
+SIMD_TARGET_SSE2 static void TransformStreamsSSE2(const Matrix4& matrix, const float* x, const float* y, const float* z, float* const* output, int rowCount, size_t count)
+{
+    // Blocks of 4 points, all the rows are calculated before storing so the output can be the input
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 pointX = _mm_loadu_ps(x + i);
+        __m128 pointY = _mm_loadu_ps(y + i);
+        __m128 pointZ = _mm_loadu_ps(z + i);
+        __m128 result[4];
+        for (int row = 0; row < rowCount; row++)
+        {
+            __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix.m[row][0]), pointX), _mm_mul_ps(_mm_set1_ps(matrix.m[row][1]), pointY));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(matrix.m[row][2]), pointZ));
+            result[row] = _mm_add_ps(sum, _mm_set1_ps(matrix.m[row][3]));
+        }
+        for (int row = 0; row < rowCount; row++)
+        {
+            _mm_storeu_ps(output[row] + i, result[row]);
+        }
+    }
+
+    // Remaining points
+    TransformStreamsScalar(matrix, x, y, z, output, rowCount, i, count);
+}
+
+SIMD_TARGET_AVX2 static void TransformStreamsAVX2(const Matrix4& matrix, const float* x, const float* y, const float* z, float* const* output, int rowCount, size_t count)
+{
+    __m256 m[4][4];
+    for (int row = 0; row < rowCount; row++)
+    {
+        for (int column = 0; column < 4; column++) m[row][column] = _mm256_set1_ps(matrix.m[row][column]);
+    }
+
+    // Blocks of 8 points, without FMA so the results are the same as the other paths
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 pointX = _mm256_loadu_ps(x + i);
+        __m256 pointY = _mm256_loadu_ps(y + i);
+        __m256 pointZ = _mm256_loadu_ps(z + i);
+        __m256 result[4];
+        for (int row = 0; row < rowCount; row++)
+        {
+            __m256 sum = _mm256_add_ps(_mm256_mul_ps(m[row][0], pointX), _mm256_mul_ps(m[row][1], pointY));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(m[row][2], pointZ));
+            result[row] = _mm256_add_ps(sum, m[row][3]);
+        }
+        for (int row = 0; row < rowCount; row++)
+        {
+            _mm256_storeu_ps(output[row] + i, result[row]);
+        }
+    }
+
+    // Remaining points
+    TransformStreamsScalar(matrix, x, y, z, output, rowCount, i, count);
+}
+
+static void TransformStreams(const Matrix4& matrix, const float* x, const float* y, const float* z, float* const* output, int rowCount, size_t count)
+{
+    static const bool avx2 = CpuSupportsAVX2();
+    static const bool sse2 = CpuSupportsSSE2();
+
+    if (avx2) TransformStreamsAVX2(matrix, x, y, z, output, rowCount, count);
+    else if (sse2) TransformStreamsSSE2(matrix, x, y, z, output, rowCount, count);
+    else TransformStreamsScalar(matrix, x, y, z, output, rowCount, 0, count);
+}
+
+#else
+
+static void TransformStreams(const Matrix4& matrix, const float* x, const float* y, const float* z, float* const* output, int rowCount, size_t count)
+{
+    TransformStreamsScalar(matrix, x, y, z, output, rowCount, 0, count);
+}
+
+#endif
+
+void Matrix4::TransformPoints(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count) const
+{
+    float* const output[] = { outX, outY, outZ };
+    TransformStreams(*this, x, y, z, output, 3, count);
+}
+
+void Matrix4::TransformPoints(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, float* outW, size_t count) const
+{
+    float* const output[] = { outX, outY, outZ, outW };
+    TransformStreams(*this, x, y, z, output, 4, count);
+}
@@ -2,9 +2,12 @@
 #define MATRIX_H
 
 #include "vector.h"
+#include "simd.h"
 #include <math.h>
+#include <stddef.h>
 
-class Matrix4
+// Rows aligned to 16 bytes so each one can be loaded into a single SSE register
+class alignas(16) Matrix4
 {
 public:
     float m[4][4];
@@ -138,9 +141,23 @@ public:
         return result;
     }
 
-    Matrix4 operator*(Matrix4 m2) const
+    Matrix4 operator*(const Matrix4& m2) const
     {
         Matrix4 result;
+#if defined(SIMD_SSE2)
+        // Each row of the result is a linear combination of the rows of the second matrix
+        __m128 row0 = _mm_load_ps(m2.m[0]);
+        __m128 row1 = _mm_load_ps(m2.m[1]);
+        __m128 row2 = _mm_load_ps(m2.m[2]);
+        __m128 row3 = _mm_load_ps(m2.m[3]);
+        for (size_t i = 0; i < 4; i++)
+        {
+            __m128 row = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[i][0]), row0), _mm_mul_ps(_mm_set1_ps(m[i][1]), row1)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[i][2]), row2), _mm_mul_ps(_mm_set1_ps(m[i][3]), row3)));
+            _mm_store_ps(result.m[i], row);
+        }
+#else
         for (size_t i = 0; i < 4; i++)
         {
             for (size_t j = 0; j < 4; j++)
@@ -151,9 +168,16 @@ public:
                                  m[i][3] * m2.m[3][j];
             }
         }
+#endif
         return result;
     }
 
+    // Transform a batch of points (w = 1) stored as structure of arrays keeping only xyz, the output can be the input
+    void TransformPoints(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count) const;
+
+    // Same keeping also the w component, for the projection to the homogeneous clip space
+    void TransformPoints(const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, float* outW, size_t count) const;
+
     static Matrix4 LookAt(Vector3 eye, Vector3 target, Vector3 up)
     {
         // Forward (z) vector in new coordinate system
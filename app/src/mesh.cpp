@@ -6,22 +6,57 @@
 #include <string>
 #include <deque>
 
-Mesh::Mesh(Window* window, std::string modelFileName, std::string textureFileName, Vector3 scale, Vector3 rotation, Vector3 translation)
+Mesh::Mesh(Window* window, std::string modelFileName, std::string textureFileName)
 {
     this->window = window;
 
-    this->scale = scale;
-    this->rotation = rotation;
-    this->translation = translation;
+    // The files are only read by the first mesh using them, the others share the same geometry and texture
+    geometry = window->resourceCache.LoadMesh(modelFileName);
+    texture = window->resourceCache.LoadTexture(textureFileName);
+}
+
+Mesh::Mesh(Window *window, Vector3 *vertices, int verticesLength, Vector3 *faces, int facesLength, uint32_t *colors, Texture2 * textureUVs)
+{
+    this->window = window;
+    std::shared_ptr<MeshGeometry> geometry = std::make_shared<MeshGeometry>();
+    MeshLOD& lod = geometry->lods[0];
+    // Initialize the dinamic vertices
+    for (size_t i = 0; i < verticesLength; i++)
+    {
+        lod.vertices.Push(vertices[i]);
+    }
+    // Initialize the dinamic faces with their colors and textures
+    for (size_t i = 0; i < facesLength; i++)
+    {
+        lod.indices.push_back(static_cast<int>(faces[i].x) - 1);
+        lod.indices.push_back(static_cast<int>(faces[i].y) - 1);
+        lod.indices.push_back(static_cast<int>(faces[i].z) - 1);
+        for (size_t j = 0; j < 3; j++)
+        {
+            lod.textureU.push_back(textureUVs[i * 3 + j].u);
+            lod.textureV.push_back(textureUVs[i * 3 + j].v);
+        }
+        lod.faceColors.push_back(colors[i]);
+    }
+
+    geometry->Build();
+    this->geometry = geometry;
+}
 
+bool MeshGeometry::LoadOBJ(const std::string& fileName)
+{
     // Open the file
-    std::ifstream modelFile(modelFileName);
+    std::ifstream modelFile(fileName);
     if (!modelFile.is_open())
     {
-        std::cerr << "Error reading the file " << modelFileName << std::endl;
-        return;
+        std::cerr << "Error reading the file " << fileName << std::endl;
+        return false;
     }
 
+    // Texture coordinates are indexed by the faces apart from the vertices
+    std::vector<Texture2> coordinates;
+    MeshLOD& lod = lods[0];
+
     // If file is loaded in memory read each line
     std::string line;
     while (std::getline(modelFile, line))
@@ -29,16 +64,16 @@ Mesh::Mesh(Window* window, std::string modelFileName, std::string textureFileNam
         // if starts with v it's a vertex
         if (line.rfind("v ", 0) == 0)
         {
-            Vector3 vertex; // %lf -> double (large float)
-            sscanf_s(line.c_str(), "v %lf %lf %lf", &vertex.x, &vertex.y, &vertex.z);
-            this->vertices.push_back(vertex);
+            Vector3 vertex;
+            sscanf_s(line.c_str(), "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
+            lod.vertices.Push(vertex);
         }
         // if starts with vt it's a texture coordinate
         else if (line.rfind("vt ", 0) == 0)
         {
             Texture2 textureCoords;
             sscanf_s(line.c_str(), "vt %f %f", &textureCoords.u, &textureCoords.v);
-            this->coordinates.push_back(textureCoords);
+            coordinates.push_back(textureCoords);
         }
         // if starts with f it's a face
         else if (line.rfind("f ", 0) == 0)
@@ -50,224 +85,862 @@ Mesh::Mesh(Window* window, std::string modelFileName, std::string textureFileNam
                    &vertexIndices[0], &textureIndices[0], &normalIndices[0],
                    &vertexIndices[1], &textureIndices[1], &normalIndices[1],
                    &vertexIndices[2], &textureIndices[2], &normalIndices[2]);
-            Vector3 face;
-            face.x = vertexIndices[0];
-            face.y = vertexIndices[1];
-            face.z = vertexIndices[2];
-            this->faces.push_back(face);
-            // recover the triangle coords using the textureIndeces
-            Texture2 triangleCoords[]{
-                this->coordinates[textureIndices[0] - 1],
-                this->coordinates[textureIndices[1] - 1],
-                this->coordinates[textureIndices[2] - 1] };
-
-            Triangle(0xFFFFFFFF, triangleCoords);
-            // Create a new triangle to store data and render it later
-            this->triangles.push_back(Triangle(0xFFFFFFFF, triangleCoords));
+            for (size_t j = 0; j < 3; j++)
+            {
+                // The OBJ indices start at 1
+                lod.indices.push_back(vertexIndices[j] - 1);
+                // recover the triangle coords using the textureIndeces
+                lod.textureU.push_back(coordinates[textureIndices[j] - 1].u);
+                lod.textureV.push_back(coordinates[textureIndices[j] - 1].v);
+            }
+            lod.faceColors.push_back(0xFFFFFFFF);
         }
     }
+    return true;
+}
 
-    // Load the texture after loading the model
-    pngTexture = upng_new_from_file(textureFileName.c_str());
-    if (pngTexture == nullptr)
+void MeshGeometry::Build()
+{
+    CalculateBounds();
+    GenerateLODs();
+}
+
+void MeshGeometry::CalculateBounds()
+{
+    const VertexStreams& vertices = lods[0].vertices;
+    if (vertices.Size() == 0) return;
+
+    // Axis aligned box of all the vertices
+    boundsMin = boundsMax = vertices.Get(0);
+    for (size_t i = 1; i < vertices.Size(); i++)
     {
-        std::cerr << "Error reading the file " << textureFileName << std::endl;
-        return;
+        boundsMin.x = std::min(boundsMin.x, vertices.x[i]);
+        boundsMin.y = std::min(boundsMin.y, vertices.y[i]);
+        boundsMin.z = std::min(boundsMin.z, vertices.z[i]);
+        boundsMax.x = std::max(boundsMax.x, vertices.x[i]);
+        boundsMax.y = std::max(boundsMax.y, vertices.y[i]);
+        boundsMax.z = std::max(boundsMax.z, vertices.z[i]);
     }
 
-    upng_decode(pngTexture);
-    if (upng_get_error(pngTexture) == UPNG_EOK)
+    // Sphere centered in the box that contains all the vertices
+    boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    boundsRadius = 0;
+    for (size_t i = 0; i < vertices.Size(); i++)
     {
-        meshTexture = (uint32_t*)upng_get_buffer(pngTexture);
-        textureWidth = upng_get_width(pngTexture);
-        textureHeight = upng_get_height(pngTexture);
+        boundsRadius = std::max(boundsRadius, (vertices.Get(i) - boundsCenter).Length());
     }
 }
 
-Mesh::Mesh(Window *window, Vector3 *vertices, int verticesLength, Vector3 *faces, int facesLength, uint32_t *colors, Texture2 * textureUVs)
+void MeshGeometry::GenerateLODs()
 {
-    this->window = window;
-    // Initialize the dinamic vertices
-    for (size_t i = 0; i < verticesLength; i++)
+    // Each level continues simplifying the previous one, until the faces are too few or it gets stuck
+    // The simplifier keeps a reference to the first level, so the vector can't grow while it's used
+    lods.reserve(MaxLODCount);
+    MeshSimplifier simplifier(lods[0]);
+    while (static_cast<int>(lods.size()) < MaxLODCount)
+    {
+        size_t previousFaceCount = lods.back().GetFaceCount();
+        size_t targetFaceCount = previousFaceCount / 2;
+        if (targetFaceCount < MinLODFaceCount) break;
+
+        simplifier.Simplify(targetFaceCount);
+        if (simplifier.GetFaceCount() > previousFaceCount * 3 / 4) break;
+
+        lods.emplace_back();
+        simplifier.GetLOD(lods.back());
+    }
+
+    // Split every level in meshlets once it isn't needed by the simplifier anymore
+    for (MeshLOD& lod : lods)
     {
-        this->vertices.push_back(vertices[i]);
+        Meshlet::Build(lod);
+        lod.CalculateFacePlanes();
     }
-    // Initialize the dinamic faces and empty triangles (same number)
-    for (size_t i = 0; i < facesLength; i++)
+}
+
+void MeshLOD::CalculateFacePlanes()
+{
+    size_t faceCount = GetFaceCount();
+    faceNormals.Resize(faceCount);
+    faceDistances.resize(faceCount);
+    for (size_t i = 0; i < faceCount; i++)
+    {
+        // Same winding as the triangles on screen (cross product AB x AC, left-handed system)
+        Vector3 a = vertices.Get(indices[i * 3]);
+        Vector3 normal = (vertices.Get(indices[i * 3 + 1]) - a).CrossProduct(vertices.Get(indices[i * 3 + 2]) - a);
+        float length = normal.Length();
+        if (length > 0) normal = normal / length;
+
+        faceNormals.x[i] = normal.x;
+        faceNormals.y[i] = normal.y;
+        faceNormals.z[i] = normal.z;
+        faceDistances[i] = -normal.DotProduct(a);
+    }
+}
+
+size_t MeshLOD::GetMemorySize() const
+{
+    return (vertices.Size() + faceNormals.Size()) * 3 * sizeof(float) + indices.size() * sizeof(int) +
+        (textureU.size() + textureV.size() + faceDistances.size()) * sizeof(float) +
+        faceColors.size() * sizeof(uint32_t) + meshlets.size() * sizeof(Meshlet);
+}
+
+size_t MeshGeometry::GetMemorySize() const
+{
+    size_t size = 0;
+    for (const MeshLOD& lod : lods)
     {
-        this->faces.push_back(faces[i]);
-        Texture2 triangleTextureUVs[]{ textureUVs[i * 3], textureUVs[i * 3 + 1], textureUVs[i * 3 + 2] };
-        this->triangles.push_back(Triangle(colors[i], triangleTextureUVs)); // con color y texturas
+        size += lod.GetMemorySize();
     }
+    return size;
 }
 
-void Mesh::Free()
+int Mesh::AddInstance(Vector3 scale, Vector3 rotation, Vector3d translation)
 {
-    upng_free(pngTexture);
+    MeshInstance instance;
+    instance.scale = scale;
+    instance.rotation = rotation;
+    instance.translation = translation;
+    instances.push_back(instance);
+    instanceDirty.push_back(0);
+    MarkInstanceDirty(static_cast<int>(instances.size()) - 1);
+    return static_cast<int>(instances.size()) - 1;
 }
 
-void Mesh::SetScale(float *scale)
+int Mesh::GetInstanceCount() const
 {
-    this->scale = {scale[0], scale[1], scale[2]};
+    return static_cast<int>(instances.size());
 }
 
-void Mesh::SetRotation(float *rotation)
+int Mesh::GetFrameInstanceCount() const
 {
-    this->rotation = {rotation[0], rotation[1], rotation[2]};
+    return static_cast<int>(frameInstances.size());
 }
 
-void Mesh::SetTranslation(float *translation)
+void Mesh::SetScale(int instance, float *scale)
+{
+    Vector3& current = instances[instance].scale;
+    if (current.x == scale[0] && current.y == scale[1] && current.z == scale[2]) return;
+    current = {scale[0], scale[1], scale[2]};
+    MarkInstanceDirty(instance);
+}
+
+void Mesh::SetRotation(int instance, float *rotation)
+{
+    Vector3& current = instances[instance].rotation;
+    if (current.x == rotation[0] && current.y == rotation[1] && current.z == rotation[2]) return;
+    current = {rotation[0], rotation[1], rotation[2]};
+    MarkInstanceDirty(instance);
+}
+
+void Mesh::SetTranslation(int instance, float *translation)
 {
     // Con rectificación de origen
-    this->translation = { translation[0], translation[1], translation[2] };
+    Vector3d& current = instances[instance].translation;
+    if (current.x == translation[0] && current.y == translation[1] && current.z == translation[2]) return;
+    current = { translation[0], translation[1], translation[2] };
+    MarkInstanceDirty(instance);
 }
 
-void Mesh::Update()
+void Mesh::MarkInstanceDirty(int instance)
 {
-    // Clear all the clippedTriangles for the current frame
-    clippedTriangles.clear();
+    // Only once in the list, the frame copies the instance as it is when it begins
+    if (instanceDirty[instance]) return;
+    instanceDirty[instance] = 1;
+    dirtyInstances.push_back(instance);
+}
 
-    // Calculate the view matrix for each frame
-    window->viewMatrix = Matrix4::LookAt(
-        window->camera.position, window->camera.GetTarget(), {0, 1, 0});  // Vector3 upDirection
+void Mesh::UpdateModelViewMatrix(int instance, const FrameView& view)
+{
+    // The translation is made relative to the camera in double precision before going to float,
+    // the view matrix goes to the left because the vertices are column vectors
+    const MeshInstance& transform = frameInstances[instance];
+    Vector3 relativeTranslation = transform.translation - view.cameraPosition;
+    modelViewMatrices[instance] = view.viewMatrix * Matrix4::WorldMatrix(transform.scale, transform.rotation, relativeTranslation);
+}
+
+const Matrix4& Mesh::GetModelViewMatrix(int instance) const
+{
+    return modelViewMatrices[instance];
+}
+
+float Mesh::GetScreenRadius(int instance, const FrameView& view) const
+{
+    // Radius in pixels of the bounding sphere seen from the camera, infinite when the camera is inside
+    const Vector3& scale = frameInstances[instance].scale;
+    Vector3 center = (Vector4(geometry->boundsCenter) * GetModelViewMatrix(instance)).ToVector3();
+    float radius = geometry->boundsRadius * std::max(std::max(fabsf(scale.x), fabsf(scale.y)), fabsf(scale.z));
+    float distanceSquared = center.DotProduct(center);
+    if (distanceSquared <= radius * radius) return INFINITY;
+
+    // Tangent of the angle of the sphere, scaled like the y axis by the projection
+    float tangent = radius / sqrtf(distanceSquared - radius * radius);
+    return tangent * view.projectionMatrix.m[1][1] * view.rendererHeight * 0.5f;
+}
+
+int Mesh::GetLODCount() const
+{
+    return static_cast<int>(geometry->lods.size());
+}
 
-    // Loop all triangle faces of the mesh
-    for (size_t i = 0; i < triangles.size(); i++)
+int Mesh::GetLOD(int instance) const
+{
+    return lodLevels[instance];
+}
+
+void Mesh::SetLOD(int instance, int level)
+{
+    lodLevels[instance] = std::max(0, std::min(level, GetLODCount() - 1));
+}
+
+size_t Mesh::GetFaceCount(int level) const
+{
+    return geometry->lods[level].GetFaceCount();
+}
+
+void Mesh::ClearVisibleInstances()
+{
+    visibleInstances.clear();
+}
+
+void Mesh::AddVisibleInstance(int instance)
+{
+    visibleInstances.push_back(instance);
+}
+
+bool Mesh::HasVisibleInstances() const
+{
+    return !visibleInstances.empty();
+}
+
+bool Mesh::IsOutsideFrustum(int instance, const FrameView& view) const
+{
+    const Frustum& frustum = view.viewFrustum;
+    const Plane* planes[] = { &frustum.leftPlane, &frustum.rightPlane, &frustum.topPlane,
+        &frustum.bottomPlane, &frustum.nearPlane, &frustum.farPlane };
+
+    // Bounding sphere first, the radius grows with the biggest scale
+    const Vector3& scale = frameInstances[instance].scale;
+    const Matrix4& modelView = GetModelViewMatrix(instance);
+    Vector3 center = (Vector4(geometry->boundsCenter) * modelView).ToVector3();
+    float radius = geometry->boundsRadius * std::max(std::max(fabsf(scale.x), fabsf(scale.y)), fabsf(scale.z));
+    bool intersects = false;
+    for (const Plane* plane : planes)
     {
-        // Create a new triangle to store data and render it later
-        triangles[i].vertices[0] = vertices[static_cast<int>(faces[i].x) - 1];
-        triangles[i].vertices[1] = vertices[static_cast<int>(faces[i].y) - 1];
-        triangles[i].vertices[2] = vertices[static_cast<int>(faces[i].z) - 1];
+        float distance = plane->Distance(center);
+        if (distance < -radius) return true;
+        if (distance < radius) intersects = true;
+    }
+    if (!intersects) return false;
 
-        /*** Apply world transformation and view transformation for all face vertices ***/
-        for (size_t j = 0; j < 3; j++)
+    // The sphere crosses some plane, the box is tighter: outside if its 8 corners are outside of the same plane
+    const Vector3& boundsMin = geometry->boundsMin;
+    const Vector3& boundsMax = geometry->boundsMax;
+    Vector3 corners[8];
+    for (int i = 0; i < 8; i++)
+    {
+        Vector3 corner{ (i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z };
+        corners[i] = (Vector4(corner) * modelView).ToVector3();
+    }
+    for (const Plane* plane : planes)
+    {
+        int outside = 0;
+        for (int i = 0; i < 8; i++)
         {
-            // World transformation to get the world space
-            triangles[i].WorldVertexTransform(j, scale, rotation, translation);
-            // View transformation to get the view space (aka camera space) 
-            triangles[i].ViewVertexTransform(j, window->viewMatrix);
+            if (!(plane->Distance(corners[i]) > 0)) outside++;
         }
+        if (outside == 8) return true;
+    }
+    return false;
+}
+
+const std::vector<int>& Mesh::GetChangedInstances() const
+{
+    return changedInstances;
+}
+
+void Mesh::UpdateWorldBounds(int instance)
+{
+    if (worldBounds.size() != frameInstances.size()) worldBounds.resize(frameInstances.size());
+    const Vector3& scale = frameInstances[instance].scale;
+    const Vector3d& translation = frameInstances[instance].translation;
+
+    // Transform the center of the box and project its half sizes over the world axes
+    Matrix4 worldMatrix = Matrix4::WorldMatrix(scale, frameInstances[instance].rotation, { 0, 0, 0 });
+    Vector3 center = (Vector4(geometry->boundsCenter) * worldMatrix).ToVector3();
+    Vector3 halfSize = (geometry->boundsMax - geometry->boundsMin) * 0.5f;
+    float extents[3];
+    for (int i = 0; i < 3; i++)
+    {
+        extents[i] = fabsf(worldMatrix.m[i][0]) * halfSize.x + fabsf(worldMatrix.m[i][1]) * halfSize.y + fabsf(worldMatrix.m[i][2]) * halfSize.z;
+    }
 
-        /*** Back Face Culling Algorithm ***/
-        triangles[i].CalculateNormal();
-        if (window->enableBackfaceCulling)
+    worldBounds[instance].min = Vector3d(translation.x + center.x - extents[0], translation.y + center.y - extents[1], translation.z + center.z - extents[2]);
+    worldBounds[instance].max = Vector3d(translation.x + center.x + extents[0], translation.y + center.y + extents[1], translation.z + center.z + extents[2]);
+}
+
+const BoundingBox& Mesh::GetWorldBounds(int instance) const
+{
+    return worldBounds[instance];
+}
+
+void Mesh::BeginFrame(FrameArena& arena)
+{
+    // The geometry stage works with the transforms of this moment, the instances can change while it runs
+    // Only the dirty ones are copied, the others are the same as in the previous frame
+    frameInstances.resize(instances.size());
+    lodLevels.resize(frameInstances.size(), 0);
+    modelViewMatrices.resize(frameInstances.size());
+    changedInstances.swap(dirtyInstances);
+    dirtyInstances.clear();
+    for (int instance : changedInstances)
+    {
+        frameInstances[instance] = instances[instance];
+        instanceDirty[instance] = 0;
+    }
+
+    // The arena has just been reset, the triangles it had are gone
+    nextTriangles = ArenaVector<Triangle>(arena);
+    nextTriangleNormals = ArenaVector<TriangleNormal>(arena);
+    nextMeshletCount = 0;
+    nextCulledMeshletCount = 0;
+}
+
+bool Mesh::HasDirtyInstances() const
+{
+    return !dirtyInstances.empty();
+}
+
+bool Mesh::HaveInstancesChanged() const
+{
+    // Only the meshes with some moved instance need their triangles again when the view doesn't change
+    return !changedInstances.empty();
+}
+
+void Mesh::AddGeometryBatches(int meshIndex, std::vector<GeometryBatch>& batches) const
+{
+    // Split the meshlets of every visible instance in ranges of about the same number of faces
+    for (int index : visibleInstances)
+    {
+        const std::vector<Meshlet>& meshlets = geometry->lods[lodLevels[index]].meshlets;
+        int first = 0;
+        while (first < static_cast<int>(meshlets.size()))
         {
-            triangles[i].ApplyCulling(&window->camera);
-            // Bypass the projection if triangle is being culled
+            int last = first;
+            int faceCount = 0;
+            while (last < static_cast<int>(meshlets.size()) && (last == first || faceCount + meshlets[last].faceCount <= BatchFaceCount))
+            {
+                faceCount += meshlets[last].faceCount;
+                last++;
+            }
+
+            GeometryBatch batch;
+            batch.mesh = meshIndex;
+            batch.instance = index;
+            batch.firstMeshlet = first;
+            batch.lastMeshlet = last;
+            batches.push_back(batch);
+            first = last;
+        }
+    }
+}
+
+void Mesh::RunGeometryBatch(GeometryBatch& batch, const FrameView& view, FrameArena& arena) const
+{
+    // The batch only reads the mesh, everything it writes is in the batch or in the stage on the arena of the thread
+    const MeshInstance& instance = frameInstances[batch.instance];
+    GeometryStage stage;
+    stage.view = &view;
+    stage.lod = &geometry->lods[lodLevels[batch.instance]];
+    stage.modelViewMatrix = GetModelViewMatrix(batch.instance);
+    stage.visibleMeshlets = ArenaVector<int>(arena);
+    stage.visibleFaces = ArenaVector<int>(arena);
+    stage.viewVertices = FrameVertexStreams{ ArenaVector<float>(arena), ArenaVector<float>(arena), ArenaVector<float>(arena) };
+    stage.clipVertices = FrameVertexStreams{ ArenaVector<float>(arena), ArenaVector<float>(arena), ArenaVector<float>(arena) };
+    stage.clipW = ArenaVector<float>(arena);
+    stage.vertexOutcodes = ArenaVector<uint16_t>(arena);
+    batch.culledMeshletCount = 0;
+    batch.triangles = ArenaVector<Triangle>(arena);
+    batch.triangleNormals = ArenaVector<TriangleNormal>(arena);
+
+    UpdateObjectCamera(instance, stage);
+    CullMeshlets(instance, batch, stage);
+    CullFaces(batch, stage);
+    TransformVertices(stage);
+    ClipFaces(batch, stage);
+    ProjectTriangles(batch, stage);
+}
+
+void Mesh::AddBatchTriangles(const GeometryBatch& batch)
+{
+    // The batches are added in the order of the instances and meshlets, like a single thread would create them
+    size_t first = nextTriangles.size();
+    nextTriangles.resize(first + batch.triangles.size());
+    std::copy(batch.triangles.begin(), batch.triangles.end(), nextTriangles.begin() + first);
+
+    first = nextTriangleNormals.size();
+    nextTriangleNormals.resize(first + batch.triangleNormals.size());
+    std::copy(batch.triangleNormals.begin(), batch.triangleNormals.end(), nextTriangleNormals.begin() + first);
+
+    nextMeshletCount += batch.lastMeshlet - batch.firstMeshlet;
+    nextCulledMeshletCount += batch.culledMeshletCount;
+}
 
-            if (triangles[i].culling)
+void Mesh::ReuseTriangles()
+{
+    // Same view and transforms, copying the current triangles to the arena of the next frame is enough
+    nextTriangles.resize(clippedTriangles.size());
+    std::copy(clippedTriangles.begin(), clippedTriangles.end(), nextTriangles.begin());
+    nextTriangleNormals.resize(triangleNormals.size());
+    std::copy(triangleNormals.begin(), triangleNormals.end(), nextTriangleNormals.begin());
+    nextMeshletCount = meshletCount;
+    nextCulledMeshletCount = culledMeshletCount;
+}
+
+void Mesh::UseNextTriangles()
+{
+    // The previous triangles stay in their arena until the geometry stage resets it for the next frame
+    clippedTriangles = nextTriangles;
+    triangleNormals = nextTriangleNormals;
+    meshletCount = nextMeshletCount;
+    culledMeshletCount = nextCulledMeshletCount;
+}
+
+int Mesh::GetNextMeshletCount() const
+{
+    return nextMeshletCount;
+}
+
+int Mesh::GetNextCulledMeshletCount() const
+{
+    return nextCulledMeshletCount;
+}
+
+void Mesh::UpdateObjectCamera(const MeshInstance& instance, GeometryStage& stage) const
+{
+    // Undo the translation, the rotations and the scale of the world matrix
+    const Vector3& scale = instance.scale;
+    const Vector3& rotation = instance.rotation;
+    stage.objectCameraValid = scale.x != 0 && scale.y != 0 && scale.z != 0;
+    stage.mirrored = scale.x * scale.y * scale.z < 0;
+    if (!stage.objectCameraValid) return;
+
+    Vector3 camera = stage.view->cameraPosition - instance.translation;
+    Matrix4 inverseRotation = Matrix4::RotationXMatrix(-rotation.x) * Matrix4::RotationYMatrix(-rotation.y) * Matrix4::RotationZMatrix(-rotation.z);
+    camera = (Vector4(camera) * inverseRotation).ToVector3();
+    stage.objectCamera = Vector3(camera.x / scale.x, camera.y / scale.y, camera.z / scale.z);
+}
+
+void Mesh::CullMeshlets(const MeshInstance& instance, GeometryBatch& batch, GeometryStage& stage) const
+{
+    const std::vector<Meshlet>& meshlets = stage.lod->meshlets;
+
+    // A mirrored mesh turns its faces around, the cones would point to the wrong side
+    const FrameView& view = *stage.view;
+    bool testCones = view.enableMeshletCulling && view.enableBackfaceCulling && stage.objectCameraValid && !stage.mirrored;
+
+    const Plane* planes[] = { &view.viewFrustum.leftPlane, &view.viewFrustum.rightPlane, &view.viewFrustum.topPlane,
+        &view.viewFrustum.bottomPlane, &view.viewFrustum.nearPlane, &view.viewFrustum.farPlane };
+    bool testFrustum = view.enableMeshletCulling && view.enableFrustumCulling;
+    const Vector3& scale = instance.scale;
+    float maxScale = std::max(std::max(fabsf(scale.x), fabsf(scale.y)), fabsf(scale.z));
+
+    for (int i = batch.firstMeshlet; i < batch.lastMeshlet; i++)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        bool culled = testCones && meshlet.IsBackfacing(stage.objectCamera);
+
+        if (!culled && testFrustum)
+        {
+            Vector3 center = (Vector4(meshlet.center) * stage.modelViewMatrix).ToVector3();
+            float radius = meshlet.radius * maxScale;
+            for (const Plane* plane : planes)
+            {
+                if (plane->Distance(center) < -radius)
+                {
+                    culled = true;
+                    break;
+                }
+            }
+        }
+
+        if (culled)
+            batch.culledMeshletCount++;
+        else
+            stage.visibleMeshlets.push_back(i);
+    }
+}
+
+void Mesh::TransformVertices(GeometryStage& stage) const
+{
+    const MeshLOD& lod = *stage.lod;
+    if (stage.visibleMeshlets.empty()) return;
+
+    // The meshlets have consecutive vertices, the streams only cover the ones of the visible meshlets of the batch
+    const Meshlet& lastMeshlet = lod.meshlets[stage.visibleMeshlets.back()];
+    stage.firstVertex = lod.meshlets[stage.visibleMeshlets[0]].firstVertex;
+    size_t vertexCount = lastMeshlet.firstVertex + lastMeshlet.vertexCount - stage.firstVertex;
+    FrameVertexStreams& viewVertices = stage.viewVertices;
+    FrameVertexStreams& clipVertices = stage.clipVertices;
+    viewVertices.Resize(vertexCount);
+    clipVertices.Resize(vertexCount);
+    stage.clipW.resize(vertexCount);
+    stage.vertexOutcodes.resize(vertexCount);
+
+    /*** Apply world, view and projection transformations once for every vertex of the visible meshlets ***/
+    float guardBand = stage.view->guardBand;
+    for (int index : stage.visibleMeshlets)
+    {
+        size_t first = lod.meshlets[index].firstVertex;
+        size_t count = lod.meshlets[index].vertexCount;
+        size_t slot = first - stage.firstVertex;
+        stage.modelViewMatrix.TransformPoints(
+            &lod.vertices.x[first], &lod.vertices.y[first], &lod.vertices.z[first],
+            &viewVertices.x[slot], &viewVertices.y[slot], &viewVertices.z[slot], count);
+
+        // Project to the clip space and get the outcode of every vertex
+        stage.view->projectionMatrix.TransformPoints(
+            &viewVertices.x[slot], &viewVertices.y[slot], &viewVertices.z[slot],
+            &clipVertices.x[slot], &clipVertices.y[slot], &clipVertices.z[slot], &stage.clipW[slot], count);
+        for (size_t i = slot; i < slot + count; i++)
+        {
+            stage.vertexOutcodes[i] = static_cast<uint16_t>(ClipSpace::ComputeOutcode(
+                clipVertices.x[i], clipVertices.y[i], clipVertices.z[i], stage.clipW[i], guardBand));
+        }
+    }
+}
+
+void Mesh::CullFaces(GeometryBatch& batch, GeometryStage& stage) const
+{
+    /*** Back face culling in object space, before transforming the vertices ***/
+    const MeshLOD& lod = *stage.lod;
+    ArenaVector<int>& visibleMeshlets = stage.visibleMeshlets;
+    ArenaVector<int>& visibleFaces = stage.visibleFaces;
+    const float* normalX = lod.faceNormals.x.data();
+    const float* normalY = lod.faceNormals.y.data();
+    const float* normalZ = lod.faceNormals.z.data();
+    const float* distances = lod.faceDistances.data();
+
+    // The camera must be in front of the plane of the face, behind it for the mirrored meshes
+    bool cull = stage.view->enableBackfaceCulling && stage.objectCameraValid;
+    float orientation = stage.mirrored ? -1.0f : 1.0f;
+    float cameraX = stage.objectCamera.x * orientation;
+    float cameraY = stage.objectCamera.y * orientation;
+    float cameraZ = stage.objectCamera.z * orientation;
+
+    size_t frontMeshletCount = 0;
+    for (int index : visibleMeshlets)
+    {
+        size_t firstVisible = visibleFaces.size();
+        size_t lastFace = lod.meshlets[index].firstFace + lod.meshlets[index].faceCount;
+        for (size_t i = lod.meshlets[index].firstFace; i < lastFace; i++)
+        {
+            if (cull && normalX[i] * cameraX + normalY[i] * cameraY + normalZ[i] * cameraZ + distances[i] * orientation < 0)
                 continue;
+
+            visibleFaces.push_back(static_cast<int>(i));
+        }
+
+        // The meshlets with only back faces don't need their vertices
+        if (visibleFaces.size() > firstVisible)
+            visibleMeshlets[frontMeshletCount++] = index;
+        else
+            batch.culledMeshletCount++;
+    }
+    visibleMeshlets.resize(frontMeshletCount);
+}
+
+void Mesh::ClipFaces(GeometryBatch& batch, const GeometryStage& stage) const
+{
+    /*** CLIPPING: IN HOMOGENEOUS CLIP SPACE, AFTER THE PROJECTION MATRIX */
+    const MeshLOD& lod = *stage.lod;
+    const FrameVertexStreams& clipVertices = stage.clipVertices;
+    const ArenaVector<float>& clipW = stage.clipW;
+    const ArenaVector<uint16_t>& vertexOutcodes = stage.vertexOutcodes;
+    ArenaVector<Triangle>& clippedTriangles = batch.triangles;
+
+    // The vertices are already in clip space with their outcodes
+    const FrameView& view = *stage.view;
+    float guardBand = view.guardBand;
+
+    // The cofactors of the model-view matrix turn the object normals into view normals, even with non uniform scales
+    const Matrix4& m = stage.modelViewMatrix;
+    Matrix4 normalMatrix = {{
+        { m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1], m.m[1][2] * m.m[2][0] - m.m[1][0] * m.m[2][2], m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0], 0 },
+        { m.m[0][2] * m.m[2][1] - m.m[0][1] * m.m[2][2], m.m[0][0] * m.m[2][2] - m.m[0][2] * m.m[2][0], m.m[0][1] * m.m[2][0] - m.m[0][0] * m.m[2][1], 0 },
+        { m.m[0][1] * m.m[1][2] - m.m[0][2] * m.m[1][1], m.m[0][2] * m.m[1][0] - m.m[0][0] * m.m[1][2], m.m[0][0] * m.m[1][1] - m.m[0][1] * m.m[1][0], 0 },
+        { 0, 0, 0, 1 },
+    }};
+
+    for (int face : stage.visibleFaces)
+    {
+        // Vertices in the streams of the batch
+        int a = lod.indices[face * 3] - stage.firstVertex;
+        int b = lod.indices[face * 3 + 1] - stage.firstVertex;
+        int c = lod.indices[face * 3 + 2] - stage.firstVertex;
+
+        // Trivial reject: all the vertices are outside of the same screen, near or far plane
+        if (vertexOutcodes[a] & vertexOutcodes[b] & vertexOutcodes[c] & ClipSpace::RejectPlanes)
+            continue;
+
+        Vector4 faceVertices[3];
+        Texture2 faceUVCoords[3];
+        for (size_t j = 0; j < 3; j++)
+        {
+            int vertex = lod.indices[face * 3 + j] - stage.firstVertex;
+            faceVertices[j] = Vector4(clipVertices.x[vertex], clipVertices.y[vertex], clipVertices.z[vertex], clipW[vertex]);
+            faceUVCoords[j] = { lod.textureU[face * 3 + j], lod.textureV[face * 3 + j] };
         }
 
-        /*** CLIPPING: BEFORE THE PROJECTION */
+        size_t firstClipped = clippedTriangles.size();
+        int outcode = (vertexOutcodes[a] | vertexOutcodes[b] | vertexOutcodes[c]) & ClipSpace::ClipPlanes;
+        if (outcode == 0)
+        {
+            // Trivial accept: the triangle is inside near/far and the guard band, the scissor does the rest
+            Triangle triangle;
+            for (size_t j = 0; j < 3; j++) triangle.vertices[j] = RasterVertex(faceVertices[j], faceUVCoords[j]);
+            clippedTriangles.push_back(triangle);
+        }
+        else
+        {
+            // Create the initial polygon with the triangle face vertices
+            Polygon polygon(faceVertices, faceUVCoords);
+            // Then do the clipping only against the planes crossed by the triangle
+            polygon.Clip(outcode, guardBand);
+            // Add the new triangles to the clippedTriangles dequeue
+            polygon.GenerateClippedTriangles(clippedTriangles);
+        }
 
-        // Create the initial polygon with the triangle face vertices
-        Polygon polygon(triangles[i]);
-        // Then do the clipping
-        polygon.Clip(window->viewFrustum);
-        // Add the new triangles to the clippedTriangles dequeue
-        polygon.GenerateClippedTriangles(clippedTriangles);
+        /** Apply flat shading, the clipped triangles keep the plane of the face ***/
+        Vector3 normal = (Vector4(lod.faceNormals.Get(face)) * normalMatrix).ToVector3();
+        normal.Normalize();
+        uint32_t color = Light::ApplyIntensity(lod.faceColors[face], -normal.DotProduct(view.lightDirection));
+        for (size_t i = firstClipped; i < clippedTriangles.size(); i++)
+        {
+            clippedTriangles[i].color = color;
+        }
+
+        // The normals for the overlay go to their own array, the triangles only keep what the rasterizer reads
+        if (view.drawTriangleNormals)
+        {
+            TriangleNormal triangleNormal;
+            triangleNormal.normal = normal;
+            for (size_t i = firstClipped; i < clippedTriangles.size(); i++)
+            {
+                batch.triangleNormals.push_back(triangleNormal);
+            }
+        }
     }
+}
 
+void Mesh::ProjectTriangles(GeometryBatch& batch, const GeometryStage& stage) const
+{
     // PROJECTING
+    const FrameView& view = *stage.view;
+    ArenaVector<Triangle>& clippedTriangles = batch.triangles;
+    ArenaVector<TriangleNormal>& triangleNormals = batch.triangleNormals;
+    bool projectNormals = view.drawTriangleNormals && triangleNormals.size() == clippedTriangles.size();
     for (size_t i = 0; i < clippedTriangles.size(); i++)
     {
-        /*** Calculate the new triangle normal ***/
-        clippedTriangles[i].CalculateNormal();
+        // Keep the view space vertices to project the normal later
+        Vector3 viewVertices[3];
+        if (projectNormals)
+        {
+            // Recover them from the clip space vertices, the perspective matrix only scales x and y and keeps z in w
+            for (size_t j = 0; j < 3; j++)
+            {
+                const RasterVertex& clipVertex = clippedTriangles[i].vertices[j];
+                viewVertices[j] = Vector3(
+                    clipVertex.x / view.projectionMatrix.m[0][0], clipVertex.y / view.projectionMatrix.m[1][1], clipVertex.w);
+            }
+        }
 
-        /*** Apply projections and lighting for all face vertices ***/
+        /*** Apply the perspective divide for all face vertices already in clip space ***/
         for (size_t j = 0; j < 3; j++)
         {
-            // Project the current vertex using matrices
-            clippedTriangles[i].ProjectWorldVertex(j, window->projectionMatrix);
+            // Divide by the original z value saved in w
+            RasterVertex& vertex = clippedTriangles[i].vertices[j];
+            if (vertex.w != 0)
+            {
+                vertex.x /= vertex.w;
+                vertex.y /= vertex.w;
+            }
             // First scale the projected vertex by screen sizes
-            clippedTriangles[i].projectedVertices[j].x *= (window->rendererWidth / 2.0);
-            clippedTriangles[i].projectedVertices[j].y *= (window->rendererHeight / 2.0);
+            vertex.x *= (view.rendererWidth / 2.0);
+            vertex.y *= (view.rendererHeight / 2.0);
             // Invert the y values to account the flipped screen y coord
-            clippedTriangles[i].projectedVertices[j].y *= -1;
+            vertex.y *= -1;
             // Then translate the projected vertex to the middle screen
-            clippedTriangles[i].projectedVertices[j].x += (window->rendererWidth / 2.0);
-            clippedTriangles[i].projectedVertices[j].y += (window->rendererHeight / 2.0);
+            vertex.x += (view.rendererWidth / 2.0);
+            vertex.y += (view.rendererHeight / 2.0);
         }
 
         // Project the normal vectors if we want to draw it
-        if (window->drawTriangleNormals)
+        if (projectNormals)
         {
             // Project the current normal to create an origin and a destiny vectors
-            clippedTriangles[i].ProjectWorldNormal(window->projectionMatrix);
+            TriangleNormal& triangleNormal = triangleNormals[i];
+            triangleNormal.ProjectWorldNormal(viewVertices, view.projectionMatrix);
             for (size_t j = 0; j < 2; j++)
             {
                 // First scale the projected vertex by screen sizes
-                clippedTriangles[i].projectedNormal[j].x *= (window->rendererWidth / 2.0);
-                clippedTriangles[i].projectedNormal[j].y *= (window->rendererHeight / 2.0);
+                triangleNormal.projectedNormal[j].x *= (view.rendererWidth / 2.0);
+                triangleNormal.projectedNormal[j].y *= (view.rendererHeight / 2.0);
                 // Invert the y values to account the flipped screen y coord
-                clippedTriangles[i].projectedNormal[j].y *= -1;
+                triangleNormal.projectedNormal[j].y *= -1;
                 // Then translate the projected vertex to the middle screen
-                clippedTriangles[i].projectedNormal[j].x += (window->rendererWidth / 2.0);
-                clippedTriangles[i].projectedNormal[j].y += (window->rendererHeight / 2.0);
+                triangleNormal.projectedNormal[j].x += (view.rendererWidth / 2.0);
+                triangleNormal.projectedNormal[j].y += (view.rendererHeight / 2.0);
             }
         }
-
-        /** Apply flat shading ***/
-        clippedTriangles[i].ApplyFlatShading(window->light);
     }
 }
 
 void Mesh::Render()
 {
+    ScreenRect screen = window->GetRendererRect();
 
     // RENDERING: Loop all projected clippedTriangles and render them
     for (size_t i = 0; i < clippedTriangles.size(); i++)
     {
-        // If culling is true and enabled globally bypass the current triangle
-        if (window->enableBackfaceCulling && clippedTriangles[i].culling)
-            continue;
+        RenderTriangle(i, screen);
+        RenderTriangleOverlays(i);
+    }
+}
 
-        // Triángulos
-        if (window->drawFilledTriangles && !window->drawTexturedTriangles)
-        {
-            window->DrawFilledTriangle(
-                clippedTriangles[i].projectedVertices[0].x, clippedTriangles[i].projectedVertices[0].y, clippedTriangles[i].projectedVertices[0].z, clippedTriangles[i].projectedVertices[0].w,
-                clippedTriangles[i].projectedVertices[1].x, clippedTriangles[i].projectedVertices[1].y, clippedTriangles[i].projectedVertices[1].z, clippedTriangles[i].projectedVertices[1].w,
-                clippedTriangles[i].projectedVertices[2].x, clippedTriangles[i].projectedVertices[2].y, clippedTriangles[i].projectedVertices[2].z, clippedTriangles[i].projectedVertices[2].w,
-                clippedTriangles[i].color);
-        }
+void Mesh::BinTriangles(int meshIndex, TileBinner& binner)
+{
+    // Only the filled and textured triangles are rasterized by tiles
+    if (!window->drawFilledTriangles && !window->drawTexturedTriangles)
+        return;
 
-        // Triángulos texturizados
-        if (window->drawTexturedTriangles)
-        {
-            window->DrawTexturedTriangle(
-                clippedTriangles[i].projectedVertices[0].x, clippedTriangles[i].projectedVertices[0].y, clippedTriangles[i].projectedVertices[0].z, clippedTriangles[i].projectedVertices[0].w, clippedTriangles[i].textureUVCoords[0],
-                clippedTriangles[i].projectedVertices[1].x, clippedTriangles[i].projectedVertices[1].y, clippedTriangles[i].projectedVertices[1].z, clippedTriangles[i].projectedVertices[1].w, clippedTriangles[i].textureUVCoords[1],
-                clippedTriangles[i].projectedVertices[2].x, clippedTriangles[i].projectedVertices[2].y, clippedTriangles[i].projectedVertices[2].z, clippedTriangles[i].projectedVertices[2].w, clippedTriangles[i].textureUVCoords[2],
-                meshTexture, textureWidth, textureHeight);
-        }
+    for (size_t i = 0; i < clippedTriangles.size(); i++)
+    {
+        // Same integer screen coordinates the rasterizer will receive
+        const RasterVertex* vertices = clippedTriangles[i].vertices;
+        int x0 = static_cast<int>(vertices[0].x);
+        int y0 = static_cast<int>(vertices[0].y);
+        int x1 = static_cast<int>(vertices[1].x);
+        int y1 = static_cast<int>(vertices[1].y);
+        int x2 = static_cast<int>(vertices[2].x);
+        int y2 = static_cast<int>(vertices[2].y);
 
-        // Wireframe
-        if (window->drawWireframe)
-        {
-            window->DrawTriangle3D(
-                clippedTriangles[i].projectedVertices[0].x, clippedTriangles[i].projectedVertices[0].y, clippedTriangles[i].projectedVertices[0].w,
-                clippedTriangles[i].projectedVertices[1].x, clippedTriangles[i].projectedVertices[1].y, clippedTriangles[i].projectedVertices[1].w,
-                clippedTriangles[i].projectedVertices[2].x, clippedTriangles[i].projectedVertices[2].y, clippedTriangles[i].projectedVertices[2].w,
-                0xFF000000);
-        }
+        TriangleRef ref;
+        ref.mesh = meshIndex;
+        ref.triangle = static_cast<int>(i);
+        binner.Bin(ref,
+            std::min(std::min(x0, x1), x2), std::min(std::min(y0, y1), y2),
+            std::max(std::max(x0, x1), x2), std::max(std::max(y0, y1), y2));
+    }
+}
 
-        // Triangle normals
-        if (window->drawTriangleNormals)
-        {
-            window->DrawLine3D(
-                clippedTriangles[i].projectedNormal[0].x, clippedTriangles[i].projectedNormal[0].y, clippedTriangles[i].projectedNormal[0].w,
-                clippedTriangles[i].projectedNormal[1].x, clippedTriangles[i].projectedNormal[1].y, clippedTriangles[i].projectedNormal[1].w,
-                0xFF07EB07);
-        }
+void Mesh::RenderTriangle(size_t i, ScreenRect clip)
+{
+    // The back faces were already discarded in object space, the triangles here are all drawn
+    // The rasterizer doesn't use the z, it interpolates 1/w for the depth
+    const RasterVertex* vertices = clippedTriangles[i].vertices;
 
-        // Vértices
-        if (window->drawWireframeDots)
-        {
-            window->DrawRect(clippedTriangles[i].projectedVertices[0].x - 1, clippedTriangles[i].projectedVertices[0].y - 1, 3, 3, 0xFF00FFFF);
-            window->DrawRect(clippedTriangles[i].projectedVertices[1].x - 1, clippedTriangles[i].projectedVertices[1].y - 1, 3, 3, 0xFF00FFFF);
-            window->DrawRect(clippedTriangles[i].projectedVertices[2].x - 1, clippedTriangles[i].projectedVertices[2].y - 1, 3, 3, 0xFF00FFFF);
-        }
+    // Triángulos
+    if (window->drawFilledTriangles && !window->drawTexturedTriangles)
+    {
+        window->DrawFilledTriangle(
+            vertices[0].x, vertices[0].y, 0, vertices[0].w,
+            vertices[1].x, vertices[1].y, 0, vertices[1].w,
+            vertices[2].x, vertices[2].y, 0, vertices[2].w,
+            clippedTriangles[i].color, clip);
+    }
+
+    // Triángulos texturizados
+    if (window->drawTexturedTriangles)
+    {
+        window->DrawTexturedTriangle(
+            vertices[0].x, vertices[0].y, 0, vertices[0].w, vertices[0].GetUV(),
+            vertices[1].x, vertices[1].y, 0, vertices[1].w, vertices[1].GetUV(),
+            vertices[2].x, vertices[2].y, 0, vertices[2].w, vertices[2].GetUV(),
+            texture ? texture->pixels : nullptr, texture ? texture->width : 0, texture ? texture->height : 0, clip);
+    }
+}
+
+size_t Mesh::GetTriangleCount()
+{
+    return clippedTriangles.size();
+}
+
+void Mesh::RenderTriangleVisibility(size_t i, uint32_t id, ScreenRect clip)
+{
+    // Only the depth and the triangle id are written, the shading is done later once per pixel
+    const RasterVertex* vertices = clippedTriangles[i].vertices;
+    Texture2 uv{ 0, 0 };
+    window->RasterizeTriangle(
+        vertices[0].x, vertices[0].y, vertices[0].w, uv,
+        vertices[1].x, vertices[1].y, vertices[1].w, uv,
+        vertices[2].x, vertices[2].y, vertices[2].w, uv,
+        id, nullptr, 0, 0, window->visibilityBuffer, clip);
+}
+
+bool Mesh::SetupTriangleShading(size_t i, TriangleSetup& setup, RasterSpan& span)
+{
+    const RasterVertex* vertices = clippedTriangles[i].vertices;
+    Texture2 uv[3]{ vertices[0].GetUV(), vertices[1].GetUV(), vertices[2].GetUV() };
+
+    if (window->drawTexturedTriangles)
+    {
+        // Flip the V component to account for inverted UV-coordinates, like DrawTexturedTriangle
+        for (size_t j = 0; j < 3; j++) uv[j].v = 1 - uv[j].v;
+        span.texture = texture ? texture->pixels : nullptr;
+        span.textureWidth = texture ? texture->width : 0;
+        span.textureHeight = texture ? texture->height : 0;
+    }
+    else
+    {
+        span.texture = nullptr;
+        span.color = clippedTriangles[i].color;
+    }
+
+    // Same integer screen coordinates used when rasterizing the visibility
+    return setup.Setup(
+        vertices[0].x, vertices[0].y, vertices[0].w, uv[0],
+        vertices[1].x, vertices[1].y, vertices[1].w, uv[1],
+        vertices[2].x, vertices[2].y, vertices[2].w, uv[2]);
+}
+
+void Mesh::RenderOverlays()
+{
+    for (size_t i = 0; i < clippedTriangles.size(); i++)
+    {
+        RenderTriangleOverlays(i);
+    }
+}
+
+void Mesh::RenderTriangleOverlays(size_t i)
+{
+    const RasterVertex* vertices = clippedTriangles[i].vertices;
+
+    // Wireframe
+    if (window->drawWireframe)
+    {
+        window->DrawTriangle3D(
+            vertices[0].x, vertices[0].y, vertices[0].w,
+            vertices[1].x, vertices[1].y, vertices[1].w,
+            vertices[2].x, vertices[2].y, vertices[2].w,
+            0xFF000000);
+    }
+
+    // Triangle normals, only projected when the option was already enabled in the geometry stage
+    if (window->drawTriangleNormals && i < triangleNormals.size())
+    {
+        const TriangleNormal& triangleNormal = triangleNormals[i];
+        window->DrawLine3D(
+            triangleNormal.projectedNormal[0].x, triangleNormal.projectedNormal[0].y, triangleNormal.projectedNormal[0].w,
+            triangleNormal.projectedNormal[1].x, triangleNormal.projectedNormal[1].y, triangleNormal.projectedNormal[1].w,
+            0xFF07EB07);
+    }
+
+    // Vértices
+    if (window->drawWireframeDots)
+    {
+        window->DrawRect(vertices[0].x - 1, vertices[0].y - 1, 3, 3, 0xFF00FFFF);
+        window->DrawRect(vertices[1].x - 1, vertices[1].y - 1, 3, 3, 0xFF00FFFF);
+        window->DrawRect(vertices[2].x - 1, vertices[2].y - 1, 3, 3, 0xFF00FFFF);
     }
 }
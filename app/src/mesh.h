@@ -4,44 +4,258 @@
 #include <iostream>
 #include <vector>
 #include <deque>
+#include <memory>
 #include "vector.h"
 #include "triangle.h"
 #include "upng.h"
+#include "tilebinner.h"
+#include "trianglesetup.h"
+#include "clipping.h"
+#include "bvh.h"
+#include "meshsimplifier.h"
+#include "meshlet.h"
+#include "framearena.h"
+#include "frameview.h"
 
 // Para prevenir dependencias cíclicas
 class Window;
 
-class Mesh
+// Points stored as structure of arrays, one contiguous stream of floats per component
+template <typename Stream>
+class BasicVertexStreams
+{
+public:
+    Stream x;
+    Stream y;
+    Stream z;
+
+    size_t Size() const
+    {
+        return x.size();
+    }
+
+    void Resize(size_t size)
+    {
+        x.resize(size);
+        y.resize(size);
+        z.resize(size);
+    }
+
+    void Push(Vector3 point)
+    {
+        x.push_back(point.x);
+        y.push_back(point.y);
+        z.push_back(point.z);
+    }
+
+    Vector3 Get(size_t i) const
+    {
+        return Vector3(x[i], y[i], z[i]);
+    }
+};
+
+typedef BasicVertexStreams<std::vector<float>> VertexStreams;
+// The same streams in the frame arena, for the vertices transformed every frame
+typedef BasicVertexStreams<ArenaVector<float>> FrameVertexStreams;
+
+// Geometry of a level of detail, with only the vertices used by its faces
+class MeshLOD
+{
+public:
+    VertexStreams vertices;
+    std::vector<int> indices;           // Three vertex indices (zero based) for each face
+    std::vector<float> textureU;        // UV coordinates for each corner of each face
+    std::vector<float> textureV;
+    std::vector<uint32_t> faceColors;
+    VertexStreams faceNormals;          // Plane of each face in object space, normal and distance to the origin
+    std::vector<float> faceDistances;
+    std::vector<Meshlet> meshlets;      // Consecutive ranges of vertices and faces
+
+    size_t GetFaceCount() const
+    {
+        return faceColors.size();
+    }
+
+    void CalculateFacePlanes();
+    size_t GetMemorySize() const;
+};
+
+// Geometry of a model with all its levels of detail, shared by the meshes loading the same file
+class MeshGeometry
+{
+public:
+    // Levels of detail generated when loading, each one with about half the faces of the previous
+    static const int MaxLODCount = 5;
+    static const int MinLODFaceCount = 64;
+
+    std::vector<MeshLOD> lods = std::vector<MeshLOD>(1); // The first level is the original geometry
+
+    // Bounding volumes in object space
+    Vector3 boundsMin{ 0, 0, 0 };
+    Vector3 boundsMax{ 0, 0, 0 };
+    Vector3 boundsCenter{ 0, 0, 0 };
+    float boundsRadius{ 0 };
+
+    // Read the first level from an OBJ file
+    bool LoadOBJ(const std::string& fileName);
+    // Calculate the bounds and the other levels once the first one is filled
+    void Build();
+    size_t GetMemorySize() const;
+
+private:
+    void CalculateBounds();
+    void GenerateLODs();
+};
+
+// Placement of a copy of a mesh in the world, all the copies share the geometry and the texture
+class MeshInstance
 {
 public:
     Vector3 scale{1, 1, 1};
     Vector3 rotation{0, 0, 0};
-    Vector3 rotationAmount{0, 0, 0};
-    Vector3 translation{0, 0, 0};
-    std::vector<Vector3> vertices;
-    std::vector<Texture2> coordinates;
+    Vector3d translation{0, 0, 0}; // Double precision world position
+};
+
+// Part of the geometry stage of a mesh: a range of the meshlets of one of its visible instances
+// The batches don't depend on each other, any thread can run them and their triangles go to the arena of that thread
+class GeometryBatch
+{
+public:
+    int mesh{ 0 };
+    int instance{ 0 };
+    int firstMeshlet{ 0 };
+    int lastMeshlet{ 0 };               // One past the last meshlet of the range
+
+    int culledMeshletCount{ 0 };
+    ArenaVector<Triangle> triangles;    // Projected triangles of the batch
+    ArenaVector<TriangleNormal> triangleNormals;
+};
+
+// Transform of the instance and streams of a batch while it goes through the geometry stage
+class GeometryStage
+{
+public:
+    const FrameView* view{ nullptr };
+    const MeshLOD* lod{ nullptr };
+    Matrix4 modelViewMatrix;            // Object to view space of the instance
+
+    // Camera in object space for the culling of the instance
+    Vector3 objectCamera{ 0, 0, 0 };
+    bool objectCameraValid{ false };    // A zero scale flattens the mesh and has no inverse
+    bool mirrored{ false };             // A negative scale turns the faces around
+
+    // Only for the vertices of the visible meshlets, the vertex streams start at the first vertex of the batch
+    ArenaVector<int> visibleMeshlets;
+    ArenaVector<int> visibleFaces;      // Faces not discarded by the back face culling
+    int firstVertex{ 0 };
+    FrameVertexStreams viewVertices;    // Vertices in view space
+    FrameVertexStreams clipVertices;    // Vertices in homogeneous clip space
+    ArenaVector<float> clipW;
+    ArenaVector<uint16_t> vertexOutcodes; // Clip space planes each vertex is outside of
+};
+
+class Mesh
+{
+public:
+    // The instances are split in geometry batches of meshlets with about this number of faces
+    static const int BatchFaceCount = 1024;
 
 private:
     Window* window{ nullptr };
-    std::vector<Vector3> faces;
-    std::vector<Triangle> triangles;
-    std::vector<Triangle> clippedTriangles;
+    std::shared_ptr<const MeshGeometry> geometry; // Levels of detail and bounds, loaded once for each file
+
+    // Transforms of the instances, only changed through AddInstance and the setters so they are marked as dirty
+    std::vector<MeshInstance> instances;
+    std::vector<int> dirtyInstances;    // Instances changed since the last frame began
+    std::vector<char> instanceDirty;
+
+    // World space box of every instance for the scene BVH
+    std::vector<BoundingBox> worldBounds;
+
+    // Copy of the instances taken when the frame begins, the only one read by the geometry stage,
+    // and the level of detail selected for each of them
+    std::vector<MeshInstance> frameInstances;
+    std::vector<int> lodLevels;
+    std::vector<Matrix4> modelViewMatrices; // Calculated once per frame for the instances that reach the culling
+    std::vector<int> changedInstances;  // Dirty instances copied when the frame began, their bounds need updating
+
+    // Instances to draw in the current frame, set by the render engine
+    std::vector<int> visibleInstances;
 
-    int textureWidth{ 0 };
-    int textureHeight{ 0 };
-    upng_t* pngTexture{ nullptr };
-    uint32_t* meshTexture{ nullptr };
+    // Triangles of all the visible instances, joined from the geometry batches in the frame arena of the render engine
+    // The geometry stage fills the next ones while the current ones are rasterized, then they change places
+    ArenaVector<Triangle> clippedTriangles;
+    ArenaVector<TriangleNormal> triangleNormals; // Normal of every triangle, only when they are drawn
+    ArenaVector<Triangle> nextTriangles;
+    ArenaVector<TriangleNormal> nextTriangleNormals;
+
+    // Meshlets of the visible instances and how many were culled, for the current and the next triangles
+    int meshletCount{ 0 };
+    int culledMeshletCount{ 0 };
+    int nextMeshletCount{ 0 };
+    int nextCulledMeshletCount{ 0 };
+
+    std::shared_ptr<const TextureImage> texture; // Null when it couldn't be loaded
 
 public:
     Mesh() = default;
-    Mesh(Window *window, std::string modelFileName, std::string textureFileName, Vector3 scale, Vector3 rotation, Vector3 translation);
+    Mesh(Window *window, std::string modelFileName, std::string textureFileName);
     Mesh(Window *window, Vector3 *vertices, int verticesLength, Vector3 *faces, int facesLength, uint32_t *colors, Texture2 *textures);
-    void Free();
-    void SetScale(float *scale);
-    void SetRotation(float *rotation);
-    void SetTranslation(float *translation);
-    void Update();
+
+    // Only moved, the streams of the geometry stage are too big to be copied by accident
+    // The geometry and the texture are released with the last mesh using them
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+
+    int AddInstance(Vector3 scale, Vector3 rotation, Vector3d translation);
+    int GetInstanceCount() const;
+    int GetFrameInstanceCount() const;
+    void SetScale(int instance, float *scale);
+    void SetRotation(int instance, float *rotation);
+    void SetTranslation(int instance, float *translation);
+    const std::vector<int>& GetChangedInstances() const;
+    void UpdateWorldBounds(int instance);
+    const BoundingBox& GetWorldBounds(int instance) const;
+    void UpdateModelViewMatrix(int instance, const FrameView& view);
+    const Matrix4& GetModelViewMatrix(int instance) const;
+    bool IsOutsideFrustum(int instance, const FrameView& view) const;
+    float GetScreenRadius(int instance, const FrameView& view) const;
+    int GetLODCount() const;
+    int GetLOD(int instance) const;
+    void SetLOD(int instance, int level);
+    size_t GetFaceCount(int level) const;
+    void ClearVisibleInstances();
+    void AddVisibleInstance(int instance);
+    bool HasVisibleInstances() const;
+    void BeginFrame(FrameArena& arena);
+    bool HasDirtyInstances() const;
+    bool HaveInstancesChanged() const;
+    void AddGeometryBatches(int meshIndex, std::vector<GeometryBatch>& batches) const;
+    void RunGeometryBatch(GeometryBatch& batch, const FrameView& view, FrameArena& arena) const;
+    void AddBatchTriangles(const GeometryBatch& batch);
+    void ReuseTriangles();
+    void UseNextTriangles();
+    int GetNextMeshletCount() const;
+    int GetNextCulledMeshletCount() const;
     void Render();
+    void BinTriangles(int meshIndex, TileBinner& binner);
+    void RenderTriangle(size_t triangleIndex, ScreenRect clip);
+    void RenderOverlays();
+    size_t GetTriangleCount();
+    void RenderTriangleVisibility(size_t triangleIndex, uint32_t id, ScreenRect clip);
+    bool SetupTriangleShading(size_t triangleIndex, TriangleSetup& setup, RasterSpan& span);
+
+private:
+    void UpdateObjectCamera(const MeshInstance& instance, GeometryStage& stage) const;
+    void CullMeshlets(const MeshInstance& instance, GeometryBatch& batch, GeometryStage& stage) const;
+    void CullFaces(GeometryBatch& batch, GeometryStage& stage) const;
+    void TransformVertices(GeometryStage& stage) const;
+    void ClipFaces(GeometryBatch& batch, const GeometryStage& stage) const;
+    void ProjectTriangles(GeometryBatch& batch, const GeometryStage& stage) const;
+    void RenderTriangleOverlays(size_t triangleIndex);
+    void MarkInstanceDirty(int instance);
 };
 
 #endif
\ No newline at end of file
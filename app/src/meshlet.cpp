@@ -0,0 +1,152 @@
+#include "meshlet.h"
+#include "mesh.h"
+#include <algorithm>
+#include <math.h>
+
+bool Meshlet::IsBackfacing(const Vector3& cameraPosition) const
+{
+    if (coneCutoff >= 1) return false;
+
+    // The angle from the camera to the axis plus the angles of the sphere and the cone must stay under 90 degrees:
+    // cos(angle to axis) > sin(cone angle) + sin(sphere angle)
+    Vector3 direction = center - cameraPosition;
+    float distance = direction.Length();
+    return direction.DotProduct(coneAxis) > coneCutoff * distance + radius;
+}
+
+void Meshlet::Build(MeshLOD& lod)
+{
+    size_t faceCount = lod.GetFaceCount();
+    size_t vertexCount = lod.vertices.Size();
+
+    // Faces using each vertex, to grow the meshlets through the neighbour faces
+    std::vector<std::vector<int>> vertexFaces(vertexCount);
+    for (size_t i = 0; i < lod.indices.size(); i++)
+    {
+        vertexFaces[lod.indices[i]].push_back(static_cast<int>(i / 3));
+    }
+
+    MeshLOD result;
+    std::vector<char> assignedFaces(faceCount, 0);
+    std::vector<int> vertexMeshlets(vertexCount, -1);
+    std::vector<int> vertexSlots(vertexCount, -1);
+    std::vector<int> faces;
+    std::vector<int> vertices;
+    std::vector<int> frontier;
+    size_t seed = 0;
+
+    while (true)
+    {
+        // Start each meshlet from the first face without one, so their order follows the original faces
+        while (seed < faceCount && assignedFaces[seed]) seed++;
+        if (seed == faceCount) break;
+
+        int id = static_cast<int>(result.meshlets.size());
+        faces.clear();
+        vertices.clear();
+        frontier.clear();
+        frontier.push_back(static_cast<int>(seed));
+
+        // Add the neighbour faces in breadth first order while the limits allow it
+        for (size_t k = 0; k < frontier.size() && faces.size() < MaxFaces; k++)
+        {
+            int face = frontier[k];
+            if (assignedFaces[face]) continue;
+
+            size_t newVertices = 0;
+            for (int j = 0; j < 3; j++)
+            {
+                if (vertexMeshlets[lod.indices[face * 3 + j]] != id) newVertices++;
+            }
+            if (vertices.size() + newVertices > MaxVertices) continue;
+
+            assignedFaces[face] = 1;
+            faces.push_back(face);
+            for (int j = 0; j < 3; j++)
+            {
+                int vertex = lod.indices[face * 3 + j];
+                if (vertexMeshlets[vertex] == id) continue;
+                vertexMeshlets[vertex] = id;
+                vertices.push_back(vertex);
+                for (int neighbour : vertexFaces[vertex])
+                {
+                    if (!assignedFaces[neighbour]) frontier.push_back(neighbour);
+                }
+            }
+        }
+
+        // Keep the original order of the faces inside the meshlet
+        std::sort(faces.begin(), faces.end());
+
+        Meshlet meshlet;
+        meshlet.firstVertex = static_cast<int>(result.vertices.Size());
+        meshlet.firstFace = static_cast<int>(result.GetFaceCount());
+        meshlet.faceCount = static_cast<int>(faces.size());
+
+        Vector3 normalSum{ 0, 0, 0 };
+        std::vector<Vector3> normals;
+        for (int face : faces)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                // Copy the vertices in the order of their first use
+                int vertex = lod.indices[face * 3 + j];
+                if (vertexSlots[vertex] < meshlet.firstVertex)
+                {
+                    vertexSlots[vertex] = static_cast<int>(result.vertices.Size());
+                    result.vertices.Push(lod.vertices.Get(vertex));
+                }
+                result.indices.push_back(vertexSlots[vertex]);
+                result.textureU.push_back(lod.textureU[face * 3 + j]);
+                result.textureV.push_back(lod.textureV[face * 3 + j]);
+            }
+            result.faceColors.push_back(lod.faceColors[face]);
+
+            // Same normal as the back face culling, the faces without surface don't count
+            Vector3 a = lod.vertices.Get(lod.indices[face * 3]);
+            Vector3 normal = (lod.vertices.Get(lod.indices[face * 3 + 1]) - a).CrossProduct(lod.vertices.Get(lod.indices[face * 3 + 2]) - a);
+            float length = normal.Length();
+            if (length > 0)
+            {
+                normals.push_back(normal / length);
+                normalSum += normals.back();
+            }
+        }
+        meshlet.vertexCount = static_cast<int>(result.vertices.Size()) - meshlet.firstVertex;
+
+        // Bounding sphere centered in the box of the vertices
+        Vector3 boxMin = result.vertices.Get(meshlet.firstVertex);
+        Vector3 boxMax = boxMin;
+        for (int i = meshlet.firstVertex + 1; i < meshlet.firstVertex + meshlet.vertexCount; i++)
+        {
+            boxMin.x = std::min(boxMin.x, result.vertices.x[i]);
+            boxMin.y = std::min(boxMin.y, result.vertices.y[i]);
+            boxMin.z = std::min(boxMin.z, result.vertices.z[i]);
+            boxMax.x = std::max(boxMax.x, result.vertices.x[i]);
+            boxMax.y = std::max(boxMax.y, result.vertices.y[i]);
+            boxMax.z = std::max(boxMax.z, result.vertices.z[i]);
+        }
+        meshlet.center = (boxMin + boxMax) * 0.5f;
+        for (int i = meshlet.firstVertex; i < meshlet.firstVertex + meshlet.vertexCount; i++)
+        {
+            meshlet.radius = std::max(meshlet.radius, (result.vertices.Get(i) - meshlet.center).Length());
+        }
+
+        // Normal cone around the average normal, only useful when all the normals are less than 90 degrees away
+        float sumLength = normalSum.Length();
+        if (sumLength > 0)
+        {
+            meshlet.coneAxis = normalSum / sumLength;
+            float minDot = 1;
+            for (const Vector3& normal : normals)
+            {
+                minDot = std::min(minDot, normal.DotProduct(meshlet.coneAxis));
+            }
+            if (minDot > 0) meshlet.coneCutoff = sqrtf(1 - minDot * minDot);
+        }
+
+        result.meshlets.push_back(meshlet);
+    }
+
+    lod = result;
+}
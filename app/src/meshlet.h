@@ -0,0 +1,36 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "vector.h"
+
+class MeshLOD;
+
+// Small cluster of neighbour faces, culled as a whole before transforming its vertices
+class Meshlet
+{
+public:
+    static const int MaxFaces = 64;
+    static const int MaxVertices = 64;
+
+    // Ranges of the level streams, every meshlet has its own copy of the vertices it uses
+    int firstVertex{ 0 };
+    int vertexCount{ 0 };
+    int firstFace{ 0 };
+    int faceCount{ 0 };
+
+    // Bounding sphere in object space
+    Vector3 center{ 0, 0, 0 };
+    float radius{ 0 };
+
+    // Cone containing the normals of all the faces, the sine of its angle is the cutoff (1 when disabled)
+    Vector3 coneAxis{ 0, 0, 0 };
+    float coneCutoff{ 1 };
+
+    // True when all the faces are seen from behind from any point of the sphere, camera in object space
+    bool IsBackfacing(const Vector3& cameraPosition) const;
+
+    // Sort the faces of the level by meshlets and rebuild its streams
+    static void Build(MeshLOD& lod);
+};
+
+#endif
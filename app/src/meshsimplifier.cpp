@@ -0,0 +1,344 @@
+#include "meshsimplifier.h"
+#include "mesh.h"
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <math.h>
+
+void Quadric::AddPlane(double nx, double ny, double nz, double d, double weight)
+{
+    a00 += weight * nx * nx;
+    a01 += weight * nx * ny;
+    a02 += weight * nx * nz;
+    a11 += weight * ny * ny;
+    a12 += weight * ny * nz;
+    a22 += weight * nz * nz;
+    b0 += weight * nx * d;
+    b1 += weight * ny * d;
+    b2 += weight * nz * d;
+    c += weight * d * d;
+}
+
+void Quadric::Add(const Quadric& q)
+{
+    a00 += q.a00;
+    a01 += q.a01;
+    a02 += q.a02;
+    a11 += q.a11;
+    a12 += q.a12;
+    a22 += q.a22;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+}
+
+double Quadric::Evaluate(const Vector3& p) const
+{
+    // Sum of the squared distances of the point to the planes, weighted by the area of their faces
+    double x = p.x, y = p.y, z = p.z;
+    return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + a11 * y * y + 2 * a12 * y * z + a22 * z * z +
+        2 * (b0 * x + b1 * y + b2 * z) + c;
+}
+
+MeshSimplifier::MeshSimplifier(const MeshLOD& source) : source(source)
+{
+    // Weld the vertices duplicated by the UV seams of the OBJ files
+    std::map<std::tuple<float, float, float>, int> positions;
+    vertexGroups.resize(source.vertices.Size());
+    for (size_t i = 0; i < source.vertices.Size(); i++)
+    {
+        auto position = std::make_tuple(source.vertices.x[i], source.vertices.y[i], source.vertices.z[i]);
+        auto found = positions.find(position);
+        if (found == positions.end())
+        {
+            found = positions.insert({ position, static_cast<int>(groupPositions.size()) }).first;
+            groupPositions.push_back(source.vertices.Get(i));
+        }
+        vertexGroups[i] = found->second;
+    }
+
+    size_t groupCount = groupPositions.size();
+    groupQuadrics.resize(groupCount);
+    groupFaces.resize(groupCount);
+    groupStamps.assign(groupCount, 0);
+    groupAlive.assign(groupCount, 1);
+
+    faceVertices = source.indices;
+    faceU = source.textureU;
+    faceV = source.textureV;
+    faceCount = source.GetFaceCount();
+    faceAlive.assign(faceCount, 1);
+
+    for (size_t face = 0; face < faceAlive.size(); face++)
+    {
+        int a = GetGroup(static_cast<int>(face), 0);
+        int b = GetGroup(static_cast<int>(face), 1);
+        int c = GetGroup(static_cast<int>(face), 2);
+
+        // Faces with two corners in the same position don't have surface
+        if (a == b || b == c || a == c)
+        {
+            faceAlive[face] = 0;
+            faceCount--;
+            continue;
+        }
+
+        // Plane of the face, weighted by its area so the small faces don't pull the vertices
+        Vector3 ab = groupPositions[b] - groupPositions[a];
+        Vector3 ac = groupPositions[c] - groupPositions[a];
+        Vector3 normal = ab.CrossProduct(ac);
+        double length = sqrt(static_cast<double>(normal.x) * normal.x + static_cast<double>(normal.y) * normal.y + static_cast<double>(normal.z) * normal.z);
+        if (length > 0)
+        {
+            double nx = normal.x / length, ny = normal.y / length, nz = normal.z / length;
+            double d = -(nx * groupPositions[a].x + ny * groupPositions[a].y + nz * groupPositions[a].z);
+            groupQuadrics[a].AddPlane(nx, ny, nz, d, length * 0.5);
+            groupQuadrics[b].AddPlane(nx, ny, nz, d, length * 0.5);
+            groupQuadrics[c].AddPlane(nx, ny, nz, d, length * 0.5);
+        }
+
+        groupFaces[a].push_back(static_cast<int>(face));
+        groupFaces[b].push_back(static_cast<int>(face));
+        groupFaces[c].push_back(static_cast<int>(face));
+    }
+
+    for (size_t group = 0; group < groupCount; group++)
+    {
+        PushBestCollapse(static_cast<int>(group));
+    }
+}
+
+int MeshSimplifier::GetGroup(int face, int corner) const
+{
+    return vertexGroups[faceVertices[face * 3 + corner]];
+}
+
+bool MeshSimplifier::GetNeighbours(int group, std::vector<int>& output)
+{
+    output.clear();
+    for (int face : groupFaces[group])
+    {
+        if (!faceAlive[face]) continue;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            int neighbour = GetGroup(face, corner);
+            if (neighbour != group) output.push_back(neighbour);
+        }
+    }
+
+    // Inside a closed surface every edge is shared by two faces, so every neighbour appears twice
+    std::sort(output.begin(), output.end());
+    bool closed = true;
+    size_t unique = 0;
+    for (size_t i = 0; i < output.size(); )
+    {
+        size_t j = i;
+        while (j < output.size() && output[j] == output[i]) j++;
+        if (j - i != 2) closed = false;
+        output[unique++] = output[i];
+        i = j;
+    }
+    output.resize(unique);
+    return closed;
+}
+
+Wedge& MeshSimplifier::GetWedge(int corner)
+{
+    for (Wedge& wedge : wedges)
+    {
+        if (wedge.u == faceU[corner] && wedge.v == faceV[corner]) return wedge;
+    }
+    wedges.push_back(Wedge());
+    wedges.back().u = faceU[corner];
+    wedges.back().v = faceV[corner];
+    return wedges.back();
+}
+
+bool MeshSimplifier::IsValidCollapse(int group, int target)
+{
+    // Expects the neighbours of the group already in the neighbours vector
+    // Only the two faces of the edge can disappear, more shared neighbours would fold the surface
+    GetNeighbours(target, targetNeighbours);
+    size_t shared = 0;
+    for (int neighbour : neighbours)
+    {
+        if (std::binary_search(targetNeighbours.begin(), targetNeighbours.end(), neighbour)) shared++;
+    }
+    if (shared != 2) return false;
+
+    Vector3 targetPosition = groupPositions[target];
+    int edgeFaces = 0;
+    wedges.clear();
+    for (int face : groupFaces[group])
+    {
+        if (!faceAlive[face]) continue;
+
+        int corners[3] = { GetGroup(face, 0), GetGroup(face, 1), GetGroup(face, 2) };
+        int corner = corners[0] == group ? 0 : corners[1] == group ? 1 : 2;
+        Wedge& wedge = GetWedge(face * 3 + corner);
+
+        int targetCorner = corners[0] == target ? 0 : corners[1] == target ? 1 : corners[2] == target ? 2 : -1;
+        if (targetCorner != -1)
+        {
+            // The faces of the edge give the new UV coordinates for the faces with the same ones in the vertex
+            targetCorner += face * 3;
+            if (wedge.targetCorner != -1 &&
+                (faceU[targetCorner] != faceU[wedge.targetCorner] || faceV[targetCorner] != faceV[wedge.targetCorner]))
+                return false;
+            wedge.targetCorner = targetCorner;
+            edgeFaces++;
+            continue;
+        }
+
+        // The other faces can't turn over when the vertex moves to the target
+        Vector3 points[3];
+        Vector3 movedPoints[3];
+        for (int j = 0; j < 3; j++)
+        {
+            points[j] = groupPositions[corners[j]];
+            movedPoints[j] = corners[j] == group ? targetPosition : points[j];
+        }
+        Vector3 normal = (points[1] - points[0]).CrossProduct(points[2] - points[0]);
+        Vector3 movedNormal = (movedPoints[1] - movedPoints[0]).CrossProduct(movedPoints[2] - movedPoints[0]);
+        if (normal.DotProduct(movedNormal) <= 0) return false;
+    }
+    if (edgeFaces != 2) return false;
+
+    // A UV seam can only collapse along itself, else some faces wouldn't know their new UV coordinates
+    for (const Wedge& wedge : wedges)
+    {
+        if (wedge.targetCorner == -1) return false;
+    }
+    return true;
+}
+
+void MeshSimplifier::PushBestCollapse(int group)
+{
+    // The old candidates of the group are discarded when they come out of the queue
+    groupStamps[group]++;
+    if (!groupAlive[group]) return;
+
+    // The vertices of the borders are kept to not open holes
+    if (!GetNeighbours(group, neighbours)) return;
+
+    EdgeCollapse best;
+    best.vertex = -1;
+    for (int target : neighbours)
+    {
+        if (!IsValidCollapse(group, target)) continue;
+
+        Quadric quadric = groupQuadrics[group];
+        quadric.Add(groupQuadrics[target]);
+        double cost = quadric.Evaluate(groupPositions[target]);
+        if (best.vertex == -1 || cost < best.cost)
+        {
+            best.cost = cost;
+            best.vertex = group;
+            best.target = target;
+        }
+    }
+
+    if (best.vertex != -1)
+    {
+        best.stamp = groupStamps[group];
+        collapses.push(best);
+    }
+}
+
+void MeshSimplifier::Collapse(int group, int target)
+{
+    // The corners of the group take the vertex and the UV coordinates of the target in the faces of the edge,
+    // using the wedges found by the last IsValidCollapse
+
+    for (int face : groupFaces[group])
+    {
+        if (!faceAlive[face]) continue;
+
+        if (GetGroup(face, 0) == target || GetGroup(face, 1) == target || GetGroup(face, 2) == target)
+        {
+            faceAlive[face] = 0;
+            faceCount--;
+            continue;
+        }
+
+        for (int corner = face * 3; corner < face * 3 + 3; corner++)
+        {
+            if (vertexGroups[faceVertices[corner]] != group) continue;
+            int targetCorner = GetWedge(corner).targetCorner;
+            faceVertices[corner] = faceVertices[targetCorner];
+            faceU[corner] = faceU[targetCorner];
+            faceV[corner] = faceV[targetCorner];
+        }
+        groupFaces[target].push_back(face);
+    }
+
+    groupQuadrics[target].Add(groupQuadrics[group]);
+    groupAlive[group] = 0;
+    groupFaces[group].clear();
+    std::vector<int>& targetFaces = groupFaces[target];
+    targetFaces.erase(std::remove_if(targetFaces.begin(), targetFaces.end(), [this](int face) { return !faceAlive[face]; }), targetFaces.end());
+
+    // Only the candidates around the target can have changed
+    std::vector<int> changedGroups;
+    GetNeighbours(target, changedGroups);
+    PushBestCollapse(target);
+    for (int neighbour : changedGroups)
+    {
+        PushBestCollapse(neighbour);
+    }
+}
+
+bool MeshSimplifier::Simplify(size_t targetFaceCount)
+{
+    while (faceCount > targetFaceCount)
+    {
+        if (collapses.empty()) return false;
+
+        EdgeCollapse collapse = collapses.top();
+        collapses.pop();
+        if (!groupAlive[collapse.vertex] || collapse.stamp != groupStamps[collapse.vertex]) continue;
+
+        // Check again in case the surroundings have changed since it was queued
+        GetNeighbours(collapse.vertex, neighbours);
+        if (!groupAlive[collapse.target] || !IsValidCollapse(collapse.vertex, collapse.target))
+        {
+            PushBestCollapse(collapse.vertex);
+            continue;
+        }
+
+        Collapse(collapse.vertex, collapse.target);
+    }
+    return true;
+}
+
+size_t MeshSimplifier::GetFaceCount() const
+{
+    return faceCount;
+}
+
+void MeshSimplifier::GetLOD(MeshLOD& lod) const
+{
+    lod = MeshLOD();
+
+    // Number again the vertices used by the remaining faces
+    std::vector<int> remap(source.vertices.Size(), -1);
+    for (size_t face = 0; face < faceAlive.size(); face++)
+    {
+        if (!faceAlive[face]) continue;
+
+        for (size_t corner = face * 3; corner < face * 3 + 3; corner++)
+        {
+            int vertex = faceVertices[corner];
+            if (remap[vertex] == -1)
+            {
+                remap[vertex] = static_cast<int>(lod.vertices.Size());
+                lod.vertices.Push(source.vertices.Get(vertex));
+            }
+            lod.indices.push_back(remap[vertex]);
+            lod.textureU.push_back(faceU[corner]);
+            lod.textureV.push_back(faceV[corner]);
+        }
+        lod.faceColors.push_back(source.faceColors[face]);
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+#include <queue>
+#include "vector.h"
+
+class MeshLOD;
+
+// Symmetric 4x4 matrix of the squared distances to a set of planes (Garland-Heckbert)
+class Quadric
+{
+public:
+    double a00{ 0 }, a01{ 0 }, a02{ 0 }, a11{ 0 }, a12{ 0 }, a22{ 0 };
+    double b0{ 0 }, b1{ 0 }, b2{ 0 };
+    double c{ 0 };
+
+    void AddPlane(double nx, double ny, double nz, double d, double weight);
+    void Add(const Quadric& q);
+    double Evaluate(const Vector3& p) const;
+};
+
+// Candidate collapse of a vertex into one of its neighbours
+class EdgeCollapse
+{
+public:
+    double cost{ 0 };
+    int vertex{ 0 };
+    int target{ 0 };
+    int stamp{ 0 };
+
+    bool operator>(const EdgeCollapse& collapse) const
+    {
+        return cost > collapse.cost;
+    }
+};
+
+// UV coordinates of a vertex in some of its faces and the corner of the target giving the new ones
+class Wedge
+{
+public:
+    float u{ 0 };
+    float v{ 0 };
+    int targetCorner{ -1 };
+};
+
+// Simplifies a mesh collapsing the edges with the smallest quadric error into one of their vertices,
+// so the surviving vertices and their UV coordinates are the original ones
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const MeshLOD& source);
+
+    // Collapse edges until there are no more than targetFaceCount faces, false if it got stuck before
+    bool Simplify(size_t targetFaceCount);
+    size_t GetFaceCount() const;
+    // Copy the remaining faces and only the vertices they use
+    void GetLOD(MeshLOD& lod) const;
+
+private:
+    const MeshLOD& source;
+
+    // The vertices with the same position are welded, the faces are not split by the UV seams
+    std::vector<int> vertexGroups;
+    std::vector<Vector3> groupPositions;
+    std::vector<Quadric> groupQuadrics;
+    std::vector<std::vector<int>> groupFaces;
+    std::vector<int> groupStamps;
+    std::vector<char> groupAlive;
+
+    // Corners of the faces, they change of vertex when it collapses
+    std::vector<int> faceVertices;
+    std::vector<float> faceU;
+    std::vector<float> faceV;
+    std::vector<char> faceAlive;
+    size_t faceCount{ 0 };
+
+    std::priority_queue<EdgeCollapse, std::vector<EdgeCollapse>, std::greater<EdgeCollapse>> collapses;
+    std::vector<int> neighbours;
+    std::vector<int> targetNeighbours;
+    std::vector<Wedge> wedges;
+
+    int GetGroup(int face, int corner) const;
+    bool GetNeighbours(int group, std::vector<int>& output);
+    Wedge& GetWedge(int corner);
+    bool IsValidCollapse(int group, int target);
+    void PushBestCollapse(int group);
+    void Collapse(int group, int target);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "resourcecache.h"
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static time_t GetModifiedTime(const std::string& fileName)
+{
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0) return 0;
+    return info.st_mtime;
+}
+
+template <typename T>
+bool ResourceCache::Find(std::unordered_map<std::string, CachedResource<T>>& entries, const std::string& fileName, time_t modifiedTime, std::shared_ptr<const T>& resource)
+{
+    auto found = entries.find(fileName);
+    if (found != entries.end() && found->second.modifiedTime == modifiedTime)
+    {
+        resource = found->second.resource.lock();
+        if (resource)
+        {
+            hitCount++;
+            return true;
+        }
+    }
+
+    // The file is going to be loaded, a good moment to forget the resources nobody uses anymore
+    missCount++;
+    RemoveReleased(entries);
+    return false;
+}
+
+template <typename T>
+void ResourceCache::RemoveReleased(std::unordered_map<std::string, CachedResource<T>>& entries)
+{
+    for (auto entry = entries.begin(); entry != entries.end();)
+    {
+        if (entry->second.resource.expired())
+            entry = entries.erase(entry);
+        else
+            ++entry;
+    }
+}
+
+template <typename T>
+size_t ResourceCache::GetResidentBytes(const std::unordered_map<std::string, CachedResource<T>>& entries)
+{
+    size_t bytes = 0;
+    for (const auto& entry : entries)
+    {
+        if (!entry.second.resource.expired()) bytes += entry.second.memorySize;
+    }
+    return bytes;
+}
+
+size_t ResourceCache::GetResidentBytes() const
+{
+    return GetResidentBytes(meshes) + GetResidentBytes(textures);
+}
+
+template <typename T>
+void ResourceCache::Store(std::unordered_map<std::string, CachedResource<T>>& entries, const std::string& fileName, time_t modifiedTime, std::shared_ptr<const T> resource, size_t memorySize)
+{
+    // Replace the old copy of a modified file, the meshes using it keep it alive until they are freed
+    CachedResource<T>& entry = entries[fileName];
+    entry.resource = resource;
+    entry.modifiedTime = modifiedTime;
+    entry.memorySize = memorySize;
+}
+
+std::shared_ptr<const MeshGeometry> ResourceCache::LoadMesh(const std::string& fileName)
+{
+    time_t modifiedTime = GetModifiedTime(fileName);
+    std::shared_ptr<const MeshGeometry> cached;
+    if (Find(meshes, fileName, modifiedTime, cached)) return cached;
+
+    // The files that can't be read give an empty geometry and are not kept, so they are tried again next time
+    std::shared_ptr<MeshGeometry> geometry = std::make_shared<MeshGeometry>();
+    if (!geometry->LoadOBJ(fileName)) return geometry;
+
+    geometry->Build();
+    Store<MeshGeometry>(meshes, fileName, modifiedTime, geometry, geometry->GetMemorySize());
+    return geometry;
+}
+
+std::shared_ptr<const TextureImage> ResourceCache::LoadTexture(const std::string& fileName)
+{
+    time_t modifiedTime = GetModifiedTime(fileName);
+    std::shared_ptr<const TextureImage> cached;
+    if (Find(textures, fileName, modifiedTime, cached)) return cached;
+
+    std::shared_ptr<TextureImage> texture = std::make_shared<TextureImage>();
+    if (!texture->Load(fileName))
+    {
+        std::cerr << "Error reading the file " << fileName << std::endl;
+        return nullptr;
+    }
+
+    Store<TextureImage>(textures, fileName, modifiedTime, texture, texture->GetMemorySize());
+    return texture;
+}
@@ -0,0 +1,59 @@
+#ifndef RESOURCECACHE_H
+#define RESOURCECACHE_H
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <time.h>
+#include "mesh.h"
+#include "texture.h"
+
+// Resource loaded from a file and the modification time of the file when it was read
+// The cache doesn't keep it alive, it's released with the last mesh using it
+template <typename T>
+class CachedResource
+{
+public:
+    std::weak_ptr<const T> resource;
+    time_t modifiedTime{ 0 };
+    size_t memorySize{ 0 };
+};
+
+// Loads every model and texture file only once while some mesh uses it, the meshes asking for the same path share the same copy
+// A file modified since it was loaded is read again, the meshes using the old copy keep it until they are freed
+class ResourceCache
+{
+public:
+    std::shared_ptr<const MeshGeometry> LoadMesh(const std::string& fileName);
+    std::shared_ptr<const TextureImage> LoadTexture(const std::string& fileName);
+
+    int GetHitCount() const
+    {
+        return hitCount;
+    }
+
+    int GetMissCount() const
+    {
+        return missCount;
+    }
+
+    // Memory used by the geometry and the decoded pixels still in use
+    size_t GetResidentBytes() const;
+
+private:
+    std::unordered_map<std::string, CachedResource<MeshGeometry>> meshes;
+    std::unordered_map<std::string, CachedResource<TextureImage>> textures;
+    int hitCount{ 0 };
+    int missCount{ 0 };
+
+    template <typename T>
+    bool Find(std::unordered_map<std::string, CachedResource<T>>& entries, const std::string& fileName, time_t modifiedTime, std::shared_ptr<const T>& resource);
+    template <typename T>
+    void RemoveReleased(std::unordered_map<std::string, CachedResource<T>>& entries);
+    template <typename T>
+    static size_t GetResidentBytes(const std::unordered_map<std::string, CachedResource<T>>& entries);
+    template <typename T>
+    void Store(std::unordered_map<std::string, CachedResource<T>>& entries, const std::string& fileName, time_t modifiedTime, std::shared_ptr<const T> resource, size_t memorySize);
+};
+
+#endif
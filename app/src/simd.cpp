@@ -0,0 +1,53 @@
+#include "simd.h"
+
+#if defined(SIMD_X86)
+
+bool CpuSupportsSSE2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    // Every x64 processor has SSE2
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool CpuSupportsAVX2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // The OS must also save the AVX registers between context switches
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+bool CpuSupportsSSE2()
+{
+    return false;
+}
+
+bool CpuSupportsAVX2()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// SSE2 is always available when compiling for x64 (or for x86 with /arch:SSE2), so it can be used without dispatch
+#if defined(SIMD_X86) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMD_SSE2
+#endif
+
+// MSVC lets us use any intrinsic in any function, GCC and Clang need to enable the instruction set per function
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#endif
+
+// Instruction sets supported by the CPU running the program
+bool CpuSupportsSSE2();
+bool CpuSupportsAVX2();
+
+#endif
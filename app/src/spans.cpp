@@ -0,0 +1,325 @@
+#include "spans.h"
+#include "simd.h"
+#include <stdlib.h>
+
+// Color of a pixel of the span: the perspective correct texel or the solid color
+static inline uint32_t ShadeSpanPixel(const RasterSpan& span, float fx, float interpolatedReciprocalW)
+{
+    if (!span.texture) return span.color;
+
+    // Now we can divide back both interpolated values by 1/w
+    float interpolatedU = (span.uDivW + span.uDivWStep * fx) / interpolatedReciprocalW;
+    float interpolatedV = (span.vDivW + span.vDivWStep * fx) / interpolatedReciprocalW;
+
+    // Calculate the texelX and texelY based on the interpolated UV and the texture sizes
+    int texelX = abs(static_cast<int>(interpolatedU * span.textureWidth)) % span.textureWidth;
+    int texelY = abs(static_cast<int>(interpolatedV * span.textureHeight)) % span.textureHeight;
+
+    return span.texture[(span.textureWidth * texelY) + texelX];
+}
+
+// Draw a single pixel of the span, also used for the pixels left at the end of the SIMD kernels
+static inline void DrawSpanPixel(const RasterSpan& span, int x)
+{
+    float fx = static_cast<float>(x);
+
+    // Find the interpolate value of 1/w for the current pixel
+    float interpolatedReciprocalW = span.oneDivW + span.oneDivWStep * fx;
+
+    // Adjust the reciprocal 1/w to the contrary distance. E.g. 0.1 -> 0.9
+    float depth = 1 - interpolatedReciprocalW;
+
+    // Only draw the pixel if the depth value is less than the one previously stored in the depth buffer
+    if (!(depth < span.depthRow[x])) return;
+
+    span.colorRow[x] = ShadeSpanPixel(span, fx, interpolatedReciprocalW);
+
+    // And update the depth for the pixel in the depthBuffer
+    span.depthRow[x] = depth;
+}
+
+// Shade a single pixel of the span without depth test
+static inline void ShadeSpanPixelAt(const RasterSpan& span, int x)
+{
+    float fx = static_cast<float>(x);
+    span.colorRow[x] = ShadeSpanPixel(span, fx, span.oneDivW + span.oneDivWStep * fx);
+}
+
+void DrawSpanScalar(const RasterSpan& span)
+{
+    for (int x = span.xStart; x <= span.xEnd; x++)
+    {
+        DrawSpanPixel(span, x);
+    }
+}
+
+void ShadeSpanScalar(const RasterSpan& span)
+{
+    // The visibility is already solved, so every pixel is shaded without any depth test
+    for (int x = span.xStart; x <= span.xEnd; x++)
+    {
+        ShadeSpanPixelAt(span, x);
+    }
+}
+
+#if defined(SIMD_X86)
+
+// Without the depth test all the pixels are visible, to shade the visibility buffer
+template <bool DepthTest>
+SIMD_TARGET_SSE2 static void SpanSSE2(const RasterSpan& span)
+{
+    const __m128 laneOffsets = _mm_setr_ps(0, 1, 2, 3);
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 oneDivW = _mm_set1_ps(span.oneDivW);
+    const __m128 uDivW = _mm_set1_ps(span.uDivW);
+    const __m128 vDivW = _mm_set1_ps(span.vDivW);
+    const __m128 oneDivWStep = _mm_set1_ps(span.oneDivWStep);
+    const __m128 uDivWStep = _mm_set1_ps(span.uDivWStep);
+    const __m128 vDivWStep = _mm_set1_ps(span.vDivWStep);
+    const __m128 textureWidth = _mm_set1_ps(static_cast<float>(span.textureWidth));
+    const __m128 textureHeight = _mm_set1_ps(static_cast<float>(span.textureHeight));
+    const __m128i color = _mm_set1_epi32(static_cast<int>(span.color));
+
+    int x = span.xStart;
+    for (; x + 3 <= span.xEnd; x += 4)
+    {
+        // Interpolate 1/w for 4 pixels and do the depth test against the depth buffer if needed
+        __m128 fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+        __m128 interpolatedReciprocalW = _mm_add_ps(oneDivW, _mm_mul_ps(oneDivWStep, fx));
+        __m128 depth = _mm_sub_ps(one, interpolatedReciprocalW);
+        __m128 oldDepth = depth;
+        __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        if (DepthTest)
+        {
+            oldDepth = _mm_loadu_ps(span.depthRow + x);
+            mask = _mm_cmplt_ps(depth, oldDepth);
+        }
+        int laneMask = _mm_movemask_ps(mask);
+        if (laneMask == 0) continue;
+
+        __m128i newColor = color;
+
+        if (span.texture)
+        {
+            // Perspective correct UV for the 4 pixels
+            __m128 interpolatedU = _mm_div_ps(_mm_add_ps(uDivW, _mm_mul_ps(uDivWStep, fx)), interpolatedReciprocalW);
+            __m128 interpolatedV = _mm_div_ps(_mm_add_ps(vDivW, _mm_mul_ps(vDivWStep, fx)), interpolatedReciprocalW);
+            alignas(16) int texelU[4];
+            alignas(16) int texelV[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(texelU), _mm_cvttps_epi32(_mm_mul_ps(interpolatedU, textureWidth)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(texelV), _mm_cvttps_epi32(_mm_mul_ps(interpolatedV, textureHeight)));
+
+            // SSE2 has no gather, so only the visible lanes read the texture
+            alignas(16) uint32_t texels[4] = { 0, 0, 0, 0 };
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (!(laneMask & (1 << lane))) continue;
+                int texelX = abs(texelU[lane]) % span.textureWidth;
+                int texelY = abs(texelV[lane]) % span.textureHeight;
+                texels[lane] = span.texture[(span.textureWidth * texelY) + texelX];
+            }
+            newColor = _mm_load_si128(reinterpret_cast<__m128i*>(texels));
+        }
+
+        if (!DepthTest)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(span.colorRow + x), newColor);
+            continue;
+        }
+
+        // Masked store: the pixels failing the depth test are not written
+        // The color row can be the memory of a locked texture, which is write only, so it's never read back
+        if (laneMask == 0xF)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(span.colorRow + x), newColor);
+        }
+        else
+        {
+            alignas(16) uint32_t colors[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(colors), newColor);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (laneMask & (1 << lane)) span.colorRow[x + lane] = colors[lane];
+            }
+        }
+        _mm_storeu_ps(span.depthRow + x, _mm_or_ps(_mm_and_ps(mask, depth), _mm_andnot_ps(mask, oldDepth)));
+    }
+
+    // Remaining pixels of the span
+    for (; x <= span.xEnd; x++)
+    {
+        if (DepthTest) DrawSpanPixel(span, x);
+        else ShadeSpanPixelAt(span, x);
+    }
+}
+
+template <bool DepthTest>
+SIMD_TARGET_AVX2 static void SpanAVX2(const RasterSpan& span)
+{
+    const __m256 laneOffsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 oneDivW = _mm256_set1_ps(span.oneDivW);
+    const __m256 uDivW = _mm256_set1_ps(span.uDivW);
+    const __m256 vDivW = _mm256_set1_ps(span.vDivW);
+    const __m256 oneDivWStep = _mm256_set1_ps(span.oneDivWStep);
+    const __m256 uDivWStep = _mm256_set1_ps(span.uDivWStep);
+    const __m256 vDivWStep = _mm256_set1_ps(span.vDivWStep);
+    const __m256 textureWidthFloat = _mm256_set1_ps(static_cast<float>(span.textureWidth));
+    const __m256 textureHeightFloat = _mm256_set1_ps(static_cast<float>(span.textureHeight));
+    const __m256i color = _mm256_set1_epi32(static_cast<int>(span.color));
+
+    // Integer modulo is done with a float division, exact while the texel coords are small enough
+    const __m256i textureWidth = _mm256_set1_epi32(span.textureWidth);
+    const __m256i textureHeight = _mm256_set1_epi32(span.textureHeight);
+    const __m256 invTextureWidth = _mm256_set1_ps(span.textureWidth ? 1.0f / span.textureWidth : 0.0f);
+    const __m256 invTextureHeight = _mm256_set1_ps(span.textureHeight ? 1.0f / span.textureHeight : 0.0f);
+    const __m256i modLimit = _mm256_set1_epi32((1 << 22) - 1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    int x = span.xStart;
+    for (; x + 7 <= span.xEnd; x += 8)
+    {
+        // Interpolate 1/w for 8 pixels and do the depth test against the depth buffer
+        __m256 fx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+        __m256 interpolatedReciprocalW = _mm256_add_ps(oneDivW, _mm256_mul_ps(oneDivWStep, fx));
+        __m256 depth = _mm256_sub_ps(one, interpolatedReciprocalW);
+        __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        if (DepthTest)
+        {
+            mask = _mm256_cmp_ps(depth, _mm256_loadu_ps(span.depthRow + x), _CMP_LT_OQ);
+            if (_mm256_movemask_ps(mask) == 0) continue;
+        }
+        __m256i maskInt = _mm256_castps_si256(mask);
+
+        __m256i newColor = color;
+        if (span.texture)
+        {
+            // Perspective correct UV for the 8 pixels
+            __m256 interpolatedU = _mm256_div_ps(_mm256_add_ps(uDivW, _mm256_mul_ps(uDivWStep, fx)), interpolatedReciprocalW);
+            __m256 interpolatedV = _mm256_div_ps(_mm256_add_ps(vDivW, _mm256_mul_ps(vDivWStep, fx)), interpolatedReciprocalW);
+            __m256i texelU = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(interpolatedU, textureWidthFloat)));
+            __m256i texelV = _mm256_abs_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(interpolatedV, textureHeightFloat)));
+
+            // Very repeated textures would lose precision in the float modulo, fall back to the scalar pixels
+            __m256i outOfRange = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpgt_epi32(texelU, modLimit), _mm256_cmpgt_epi32(zero, texelU)),
+                _mm256_or_si256(_mm256_cmpgt_epi32(texelV, modLimit), _mm256_cmpgt_epi32(zero, texelV)));
+            if (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(outOfRange, maskInt))) != 0)
+            {
+                for (int lane = 0; lane < 8; lane++)
+                {
+                    if (DepthTest) DrawSpanPixel(span, x + lane);
+                    else ShadeSpanPixelAt(span, x + lane);
+                }
+                continue;
+            }
+
+            // texel % size = texel - size * (texel / size), correcting the quotient if it is one unit off
+            __m256i quotientU = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(texelU), invTextureWidth));
+            __m256i quotientV = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(texelV), invTextureHeight));
+            __m256i texelX = _mm256_sub_epi32(texelU, _mm256_mullo_epi32(quotientU, textureWidth));
+            __m256i texelY = _mm256_sub_epi32(texelV, _mm256_mullo_epi32(quotientV, textureHeight));
+            texelX = _mm256_add_epi32(texelX, _mm256_and_si256(_mm256_cmpgt_epi32(zero, texelX), textureWidth));
+            texelY = _mm256_add_epi32(texelY, _mm256_and_si256(_mm256_cmpgt_epi32(zero, texelY), textureHeight));
+            texelX = _mm256_sub_epi32(texelX, _mm256_andnot_si256(_mm256_cmpgt_epi32(textureWidth, texelX), textureWidth));
+            texelY = _mm256_sub_epi32(texelY, _mm256_andnot_si256(_mm256_cmpgt_epi32(textureHeight, texelY), textureHeight));
+
+            // Masked gather, only the visible lanes read the texture
+            __m256i texelIndex = _mm256_add_epi32(_mm256_mullo_epi32(texelY, textureWidth), texelX);
+            newColor = _mm256_mask_i32gather_epi32(zero, reinterpret_cast<const int*>(span.texture), texelIndex, maskInt, 4);
+        }
+
+        if (!DepthTest)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(span.colorRow + x), newColor);
+            continue;
+        }
+
+        // Masked store: the pixels failing the depth test are not written
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(span.colorRow + x), maskInt, newColor);
+        _mm256_maskstore_ps(span.depthRow + x, maskInt, depth);
+    }
+
+    // Remaining pixels of the span
+    for (; x <= span.xEnd; x++)
+    {
+        if (DepthTest) DrawSpanPixel(span, x);
+        else ShadeSpanPixelAt(span, x);
+    }
+}
+
+void DrawSpanSSE2(const RasterSpan& span)
+{
+    SpanSSE2<true>(span);
+}
+
+void DrawSpanAVX2(const RasterSpan& span)
+{
+    SpanAVX2<true>(span);
+}
+
+void ShadeSpanSSE2(const RasterSpan& span)
+{
+    SpanSSE2<false>(span);
+}
+
+void ShadeSpanAVX2(const RasterSpan& span)
+{
+    SpanAVX2<false>(span);
+}
+
+SpanKernel SelectSpanKernel()
+{
+    if (CpuSupportsAVX2()) return DrawSpanAVX2;
+    if (CpuSupportsSSE2()) return DrawSpanSSE2;
+    return DrawSpanScalar;
+}
+
+SpanKernel SelectShadeKernel()
+{
+    if (CpuSupportsAVX2()) return ShadeSpanAVX2;
+    if (CpuSupportsSSE2()) return ShadeSpanSSE2;
+    return ShadeSpanScalar;
+}
+
+#else
+
+// Other architectures only have the scalar kernel
+void DrawSpanSSE2(const RasterSpan& span)
+{
+    DrawSpanScalar(span);
+}
+
+void DrawSpanAVX2(const RasterSpan& span)
+{
+    DrawSpanScalar(span);
+}
+
+void ShadeSpanSSE2(const RasterSpan& span)
+{
+    ShadeSpanScalar(span);
+}
+
+void ShadeSpanAVX2(const RasterSpan& span)
+{
+    ShadeSpanScalar(span);
+}
+
+SpanKernel SelectSpanKernel()
+{
+    return DrawSpanScalar;
+}
+
+SpanKernel SelectShadeKernel()
+{
+    return ShadeSpanScalar;
+}
+
+#endif
+
+const char* GetSpanKernelName(SpanKernel kernel)
+{
+    if (kernel == DrawSpanAVX2) return "AVX2";
+    if (kernel == DrawSpanSSE2) return "SSE2";
+    return "Escalar";
+}
@@ -0,0 +1,46 @@
+#ifndef SPANS_H
+#define SPANS_H
+
+#include <stdint.h>
+
+// Horizontal run of pixels of a triangle inside one row of the buffers
+// Every interpolated value is a line A(x) = A + step * x, taking x from the start of the row
+class RasterSpan
+{
+public:
+    uint32_t* colorRow{ nullptr };
+    float* depthRow{ nullptr };
+    int xStart{ 0 };
+    int xEnd{ 0 }; // Inclusive
+
+    float oneDivW{ 0 };
+    float uDivW{ 0 };
+    float vDivW{ 0 };
+    float oneDivWStep{ 0 };
+    float uDivWStep{ 0 };
+    float vDivWStep{ 0 };
+
+    uint32_t color{ 0xFFFFFFFF };
+    uint32_t* texture{ nullptr }; // Solid color span when there is no texture
+    int textureWidth{ 0 };
+    int textureHeight{ 0 };
+};
+
+typedef void (*SpanKernel)(const RasterSpan& span);
+
+// Pixel kernels, all of them give exactly the same result
+void DrawSpanScalar(const RasterSpan& span);
+void DrawSpanSSE2(const RasterSpan& span);
+void DrawSpanAVX2(const RasterSpan& span);
+
+// Shade the pixels of the span without depth test, used to resolve the visibility buffer
+void ShadeSpanScalar(const RasterSpan& span);
+void ShadeSpanSSE2(const RasterSpan& span);
+void ShadeSpanAVX2(const RasterSpan& span);
+
+// Best kernels supported by the CPU running the program
+SpanKernel SelectSpanKernel();
+SpanKernel SelectShadeKernel();
+const char* GetSpanKernelName(SpanKernel kernel);
+
+#endif
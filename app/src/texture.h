@@ -1,6 +1,10 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <string>
+#include <stdint.h>
+#include "upng.h"
+
 class Texture2
 {
 public:
@@ -10,4 +14,51 @@ public:
     Texture2() = default;
 };
 
+// Decoded PNG image, shared by all the meshes using it through the resource cache
+class TextureImage
+{
+public:
+    upng_t* png{ nullptr };
+    uint32_t* pixels{ nullptr };
+    int width{ 0 };
+    int height{ 0 };
+
+    TextureImage() = default;
+    TextureImage(const TextureImage&) = delete;
+    TextureImage& operator=(const TextureImage&) = delete;
+
+    ~TextureImage()
+    {
+        if (png != nullptr) upng_free(png);
+    }
+
+    bool Load(const std::string& fileName)
+    {
+        png = upng_new_from_file(fileName.c_str());
+        if (png == nullptr) return false;
+
+        upng_decode(png);
+        if (upng_get_error(png) != UPNG_EOK || upng_get_format(png) != UPNG_RGBA8) return false;
+
+        pixels = (uint32_t*)upng_get_buffer(png);
+        width = upng_get_width(png);
+        height = upng_get_height(png);
+
+        // The bytes of the PNG are R, G, B, A, turn them once into 0xAARRGGBB like the rest of the colors
+        const unsigned char* bytes = upng_get_buffer(png);
+        for (int i = 0; i < width * height; i++)
+        {
+            const unsigned char* pixel = bytes + i * 4;
+            pixels[i] = (static_cast<uint32_t>(pixel[3]) << 24) | (static_cast<uint32_t>(pixel[0]) << 16) |
+                (static_cast<uint32_t>(pixel[1]) << 8) | static_cast<uint32_t>(pixel[2]);
+        }
+        return true;
+    }
+
+    size_t GetMemorySize() const
+    {
+        return png ? upng_get_size(png) : 0;
+    }
+};
+
 #endif
\ No newline at end of file
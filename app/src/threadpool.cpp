@@ -0,0 +1,160 @@
+#include "threadpool.h"
+
+static thread_local int currentThreadIndex = 0;
+
+ThreadPool::~ThreadPool()
+{
+    StopWorkers();
+}
+
+void ThreadPool::SetThreadCount(int threadCount)
+{
+    // The calling thread also works, so we need one worker less
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount == GetThreadCount()) return;
+
+    StopWorkers();
+
+    for (int i = 0; i < threadCount - 1; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i + 1, generation));
+    }
+}
+
+int ThreadPool::GetThreadCount()
+{
+    return static_cast<int>(workers.size()) + 1;
+}
+
+int ThreadPool::GetThreadIndex()
+{
+    return currentThreadIndex;
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& task)
+{
+    // Without workers or with only one task there is nothing to split
+    if (workers.empty() || count <= 1)
+    {
+        for (int i = 0; i < count; i++) task(i);
+        return;
+    }
+
+    // Publish the new task and wake up the workers
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = &task;
+        taskCount = count;
+        nextTask = 0;
+        pendingWorkers = static_cast<int>(workers.size());
+        generation++;
+    }
+    wakeCondition.notify_all();
+
+    // The calling thread takes tasks too instead of waiting idle
+    RunTasks();
+
+    // Wait for the workers to finish their last task
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return pendingWorkers == 0; });
+    currentTask = nullptr;
+}
+
+void ThreadPool::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    stopping = false;
+}
+
+void ThreadPool::WorkerLoop(int threadIndex, unsigned int lastGeneration)
+{
+    currentThreadIndex = threadIndex;
+    while (true)
+    {
+        // Sleep until there is a new task or the pool is stopped
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [&] { return stopping || generation != lastGeneration; });
+            if (stopping) return;
+            lastGeneration = generation;
+        }
+
+        RunTasks();
+
+        // Notify the calling thread when the last worker is done
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pendingWorkers == 0) doneCondition.notify_one();
+    }
+}
+
+void ThreadPool::RunTasks()
+{
+    // Each thread takes the next free index until there are no more left
+    for (int i = nextTask++; i < taskCount; i = nextTask++)
+    {
+        (*currentTask)(i);
+    }
+}
+
+BackgroundThread::~BackgroundThread()
+{
+    if (!thread.joinable()) return;
+
+    // The current task is finished before stopping
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_one();
+    thread.join();
+}
+
+void BackgroundThread::Start(const std::function<void()>& task)
+{
+    Wait();
+
+    // The thread is only created the first time it's needed
+    if (!thread.joinable()) thread = std::thread(&BackgroundThread::ThreadLoop, this);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = &task;
+    }
+    wakeCondition.notify_one();
+}
+
+void BackgroundThread::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return currentTask == nullptr; });
+}
+
+void BackgroundThread::ThreadLoop()
+{
+    while (true)
+    {
+        // Sleep until there is a task or the thread is stopped
+        const std::function<void()>* task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this] { return stopping || currentTask != nullptr; });
+            if (stopping) return;
+            task = currentTask;
+        }
+
+        (*task)();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = nullptr;
+        doneCondition.notify_all();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Pool of persistent worker threads to split a loop of independent tasks
+class ThreadPool
+{
+public:
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    // Total number of threads working in a ParallelFor, including the calling one
+    void SetThreadCount(int threadCount);
+    int GetThreadCount();
+
+    // Run task(0..count-1) spread between all the threads and wait until all of them are finished
+    void ParallelFor(int count, const std::function<void(int)>& task);
+
+    // Index of the thread running the current task, from 1 for the workers and 0 for the calling thread
+    static int GetThreadIndex();
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const std::function<void(int)>* currentTask{ nullptr };
+    int taskCount{ 0 };
+    std::atomic<int> nextTask{ 0 };
+    int pendingWorkers{ 0 };
+    unsigned int generation{ 0 };
+    bool stopping{ false };
+
+    void StopWorkers();
+    void WorkerLoop(int threadIndex, unsigned int lastGeneration);
+    void RunTasks();
+};
+
+// Persistent thread running one task at a time in the background, while the calling thread goes on with other work
+class BackgroundThread
+{
+public:
+    BackgroundThread() = default;
+    BackgroundThread(const BackgroundThread&) = delete;
+    BackgroundThread& operator=(const BackgroundThread&) = delete;
+    ~BackgroundThread();
+
+    // Run the task in the background after the previous one, it must live until it's finished
+    void Start(const std::function<void()>& task);
+
+    // Wait until the current task is finished, it returns at once when there is none
+    void Wait();
+
+private:
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    const std::function<void()>* currentTask{ nullptr };
+    bool stopping{ false };
+
+    void ThreadLoop();
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TILEBINNER_H
+#define TILEBINNER_H
+
+#include <vector>
+#include <algorithm>
+
+// Inclusive rectangle of pixels in the renderer
+class ScreenRect
+{
+public:
+    int minX{ 0 };
+    int minY{ 0 };
+    int maxX{ 0 };
+    int maxY{ 0 };
+};
+
+// Reference to a projected triangle of a mesh
+class TriangleRef
+{
+public:
+    int mesh{ 0 };
+    int triangle{ 0 };
+};
+
+// Splits the screen in square tiles and stores which triangles overlap each one
+class TileBinner
+{
+public:
+    static const int TileSize = 64;
+
+    void Resize(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        tilesX = (width + TileSize - 1) / TileSize;
+        tilesY = (height + TileSize - 1) / TileSize;
+        bins.resize(static_cast<size_t>(tilesX) * tilesY);
+    }
+
+    void Clear()
+    {
+        // Keep the capacity of every bin to not allocate again the next frame
+        for (size_t i = 0; i < bins.size(); i++) bins[i].clear();
+    }
+
+    void Bin(TriangleRef ref, int minX, int minY, int maxX, int maxY)
+    {
+        // Clamp the triangle bounding box to the screen
+        minX = std::max(minX, 0);
+        minY = std::max(minY, 0);
+        maxX = std::min(maxX, width - 1);
+        maxY = std::min(maxY, height - 1);
+        if (minX > maxX || minY > maxY) return;
+
+        // Add the triangle to all the tiles touched by the bounding box
+        for (int ty = minY / TileSize; ty <= maxY / TileSize; ty++)
+        {
+            for (int tx = minX / TileSize; tx <= maxX / TileSize; tx++)
+            {
+                bins[static_cast<size_t>(ty) * tilesX + tx].push_back(ref);
+            }
+        }
+    }
+
+    int GetTileCount() const
+    {
+        return static_cast<int>(bins.size());
+    }
+
+    ScreenRect GetTileRect(int tile) const
+    {
+        ScreenRect rect;
+        rect.minX = (tile % tilesX) * TileSize;
+        rect.minY = (tile / tilesX) * TileSize;
+        rect.maxX = std::min(rect.minX + TileSize, width) - 1;
+        rect.maxY = std::min(rect.minY + TileSize, height) - 1;
+        return rect;
+    }
+
+    const std::vector<TriangleRef>& GetBin(int tile) const
+    {
+        return bins[tile];
+    }
+
+private:
+    int width{ 0 };
+    int height{ 0 };
+    int tilesX{ 0 };
+    int tilesY{ 0 };
+    std::vector<std::vector<TriangleRef>> bins;
+};
+
+#endif
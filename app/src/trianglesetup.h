@@ -0,0 +1,111 @@
+#ifndef TRIANGLESETUP_H
+#define TRIANGLESETUP_H
+
+#include <algorithm>
+#include "texture.h"
+#include "spans.h"
+
+// Edge equations and interpolation planes of a screen triangle, calculated once per triangle
+class TriangleSetup
+{
+public:
+    int x[3]{};
+    int y[3]{};
+    int area{ 0 };
+    float invArea{ 0 };
+
+    // Edge i is the one in front of the vertex i, its value is the weight of that vertex
+    int edgeStepX[3]{};
+    int edgeStepY[3]{};
+    int edgeBias[3]{};
+
+    float oneDivW[3]{};
+    float uDivW[3]{};
+    float vDivW[3]{};
+    float oneDivWStep{ 0 };
+    float uDivWStep{ 0 };
+    float vDivWStep{ 0 };
+
+    // Returns false for degenerated triangles without area
+    bool Setup(int x0, int y0, float w0, Texture2 uv0, int x1, int y1, float w1, Texture2 uv1, int x2, int y2, float w2, Texture2 uv2)
+    {
+        // Calculate the signed area of the triangle (twice the area) using the edge function of v0v1 in v2
+        area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+
+        // Degenerated triangles don't cover any pixel
+        if (area == 0) return false;
+
+        // Force a consistent winding so all the inside pixels have positive edge functions
+        if (area < 0)
+        {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+            std::swap(w1, w2);
+            std::swap(uv1, uv2);
+            area = -area;
+        }
+
+        x[0] = x0; x[1] = x1; x[2] = x2;
+        y[0] = y0; y[1] = y1; y[2] = y2;
+
+        // Edge equations E(x,y) = dx*(y-ya) - dy*(x-xa)
+        // Moving one pixel right subtracts dy and moving one row down adds dx
+        for (int i = 0; i < 3; i++)
+        {
+            int a = (i + 1) % 3;
+            int b = (i + 2) % 3;
+            int dx = x[b] - x[a];
+            int dy = y[b] - y[a];
+            edgeStepX[i] = -dy;
+            edgeStepY[i] = dx;
+
+            // Top-left fill rule: pixels exactly on a right or bottom edge belong to the neighbour triangle
+            // With this winding an edge is top if it is horizontal going right, and left if it goes up
+            edgeBias[i] = (dy < 0 || (dy == 0 && dx > 0)) ? 0 : -1;
+        }
+
+        // Common divisions for all the pixels in the triangle face
+        invArea = 1.0f / area;
+        oneDivW[0] = 1 / w0; oneDivW[1] = 1 / w1; oneDivW[2] = 1 / w2;
+        uDivW[0] = uv0.u / w0; uDivW[1] = uv1.u / w1; uDivW[2] = uv2.u / w2;
+        vDivW[0] = uv0.v / w0; vDivW[1] = uv1.v / w1; vDivW[2] = uv2.v / w2;
+
+        // Every attribute is a plane A(x,y) = A0 + (A1-A0)*beta + (A2-A0)*gamma, so its increment per pixel is constant
+        float betaStepX = edgeStepX[1] * invArea;
+        float gammaStepX = edgeStepX[2] * invArea;
+        oneDivWStep = (oneDivW[1] - oneDivW[0]) * betaStepX + (oneDivW[2] - oneDivW[0]) * gammaStepX;
+        uDivWStep = (uDivW[1] - uDivW[0]) * betaStepX + (uDivW[2] - uDivW[0]) * gammaStepX;
+        vDivWStep = (vDivW[1] - vDivW[0]) * betaStepX + (vDivW[2] - vDivW[0]) * gammaStepX;
+
+        return true;
+    }
+
+    // Edge value in a pixel including the fill rule bias, the pixel is inside if the three are >= 0
+    int EdgeAt(int edge, int px, int py) const
+    {
+        int a = (edge + 1) % 3;
+        return edgeStepY[edge] * (py - y[a]) + edgeStepX[edge] * (px - x[a]) + edgeBias[edge];
+    }
+
+    // The depth is 1 - 1/w and 1/w is linear in the screen, so the nearest point of the triangle is a vertex
+    float NearestDepth() const
+    {
+        return 1 - std::max(std::max(oneDivW[0], oneDivW[1]), oneDivW[2]);
+    }
+
+    // Interpolated values of the row at x = 0 from the exact edge values, without the bias
+    // Starting always from x = 0 gives the same pixels no matter how the row is split
+    void SetupRow(int py, RasterSpan& span) const
+    {
+        float beta = (EdgeAt(1, 0, py) - edgeBias[1]) * invArea;
+        float gamma = (EdgeAt(2, 0, py) - edgeBias[2]) * invArea;
+        span.oneDivW = oneDivW[0] + (oneDivW[1] - oneDivW[0]) * beta + (oneDivW[2] - oneDivW[0]) * gamma;
+        span.uDivW = uDivW[0] + (uDivW[1] - uDivW[0]) * beta + (uDivW[2] - uDivW[0]) * gamma;
+        span.vDivW = vDivW[0] + (vDivW[1] - vDivW[0]) * beta + (vDivW[2] - vDivW[0]) * gamma;
+        span.oneDivWStep = oneDivWStep;
+        span.uDivWStep = uDivWStep;
+        span.vDivWStep = vDivWStep;
+    }
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include <math.h>
 #include "vector.h"
 #include "matrix.h"
+#include "simd.h"
 
 std::ostream &operator<<(std::ostream &os, const Vector2 &v)
 {
@@ -56,12 +57,37 @@ float Vector3::Length()
     return sqrt(x * x + y * y + z * z);
 }
 
+#if defined(SIMD_SSE2)
+// The Vector3 is packed in 12 bytes, load it with w = 0 so the unused lane never adds anything
+static inline __m128 LoadVector3(const Vector3 &v)
+{
+    return _mm_set_ps(0, v.z, v.y, v.x);
+}
+
+// Sum of the xyz lanes in the same order as the scalar code, (x + y) + z
+static inline __m128 SumVector3(__m128 v)
+{
+    __m128 sum = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_add_ss(sum, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+#endif
+
 void Vector3::Normalize()
 {
+#if defined(SIMD_SSE2)
+    __m128 v = LoadVector3(*this);
+    __m128 length = _mm_sqrt_ss(SumVector3(_mm_mul_ps(v, v)));
+    Vector4 result;
+    _mm_store_ps(&result.x, _mm_div_ps(v, _mm_shuffle_ps(length, length, _MM_SHUFFLE(0, 0, 0, 0))));
+    x = result.x;
+    y = result.y;
+    z = result.z;
+#else
     float length = Length();
     x = x / length;
     y = y / length;
     z = z / length;
+#endif
 }
 
 Vector3 Vector3::operator+(const Vector3 &v) const
@@ -119,21 +145,38 @@ Vector3 Vector3::operator/(float factor) const
 
 Vector3 Vector3::CrossProduct(const Vector3 &v) const
 {
+#if defined(SIMD_SSE2)
+    // a.yzx * b.zxy - a.zxy * b.yzx
+    __m128 a = LoadVector3(*this);
+    __m128 b = LoadVector3(v);
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 bZXY = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    Vector4 result;
+    _mm_store_ps(&result.x, _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+    return Vector3(result.x, result.y, result.z);
+#else
     return Vector3(
         y * v.z - z * v.y,
         z * v.x - x * v.z,
         x * v.y - y * v.x);
+#endif
 }
 
 float Vector3::DotProduct(const Vector3 &v) const
 {
+#if defined(SIMD_SSE2)
+    return _mm_cvtss_f32(SumVector3(_mm_mul_ps(LoadVector3(*this), LoadVector3(v))));
+#else
     return (x * v.x) + (y * v.y) + (z * v.z);
+#endif
 }
 
 void Vector3::RotateX(float angle)
 {
-    double newY = y * cos(angle) - z * sin(angle);
-    double newZ = y * sin(angle) + z * cos(angle);
+    float newY = y * cos(angle) - z * sin(angle);
+    float newZ = y * sin(angle) + z * cos(angle);
 
     y = newY;
     z = newZ;
@@ -141,8 +184,8 @@ void Vector3::RotateX(float angle)
 
 void Vector3::RotateY(float angle)
 {
-    double newX = x * cos(angle) - z * sin(angle);
-    double newZ = x * sin(angle) + z * cos(angle);
+    float newX = x * cos(angle) - z * sin(angle);
+    float newZ = x * sin(angle) + z * cos(angle);
 
     x = newX;
     z = newZ;
@@ -150,8 +193,8 @@ void Vector3::RotateY(float angle)
 
 void Vector3::RotateZ(float angle)
 {
-    double newX = x * cos(angle) - y * sin(angle);
-    double newY = x * sin(angle) + y * cos(angle);
+    float newX = x * cos(angle) - y * sin(angle);
+    float newY = x * sin(angle) + y * cos(angle);
 
     x = newX;
     y = newY;
@@ -187,12 +230,55 @@ Vector3 Vector4::ToVector3()
     return Vector3(x, y, z);
 }
 
-Vector4 Vector4::operator*(Matrix4 m) const
+Vector4 Vector4::operator*(const Matrix4& m) const
 {
     Vector4 result;
+#if defined(SIMD_SSE2)
+    // Multiply each row by the vector and transpose the products to add them vertically
+    __m128 v = _mm_load_ps(&x);
+    __m128 row0 = _mm_mul_ps(_mm_load_ps(m.m[0]), v);
+    __m128 row1 = _mm_mul_ps(_mm_load_ps(m.m[1]), v);
+    __m128 row2 = _mm_mul_ps(_mm_load_ps(m.m[2]), v);
+    __m128 row3 = _mm_mul_ps(_mm_load_ps(m.m[3]), v);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+    _mm_store_ps(&result.x, _mm_add_ps(_mm_add_ps(row0, row1), _mm_add_ps(row2, row3)));
+#else
     result.x = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3] * w;
     result.y = m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z + m.m[1][3] * w;
     result.z = m.m[2][0] * x + m.m[2][1] * y + m.m[2][2] * z + m.m[2][3] * w;
     result.w = m.m[3][0] * x + m.m[3][1] * y + m.m[3][2] * z + m.m[3][3] * w;
+#endif
     return result;
+}
+
+Vector3d Vector3d::operator+(const Vector3 &v) const
+{
+    return Vector3d(x + v.x, y + v.y, z + v.z);
+}
+
+Vector3d &Vector3d::operator+=(const Vector3 &v)
+{
+    x += v.x;
+    y += v.y;
+    z += v.z;
+    return *this;
+}
+
+Vector3d &Vector3d::operator-=(const Vector3 &v)
+{
+    x -= v.x;
+    y -= v.y;
+    z -= v.z;
+    return *this;
+}
+
+Vector3 Vector3d::operator-(const Vector3d &v) const
+{
+    // The difference is small near the camera so it fits in a float without losing precision
+    return Vector3(static_cast<float>(x - v.x), static_cast<float>(y - v.y), static_cast<float>(z - v.z));
+}
+
+Vector3 Vector3d::ToVector3() const
+{
+    return Vector3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
 }
\ No newline at end of file
@@ -8,8 +8,8 @@ class Matrix4; /* Pre declaration */
 class Vector2
 {
 public:
-    double x;
-    double y;
+    float x;
+    float y;
 
     friend std::ostream &operator<<(std::ostream &os, const Vector2 &v);
     Vector2 operator+(const Vector2 &v) const;
@@ -18,18 +18,19 @@ public:
     Vector2 operator/(float factor) const;
 
     Vector2() = default;
-    Vector2(double x, double y) : x(x), y(y){};
+    Vector2(float x, float y) : x(x), y(y){};
     void Normalize();
     float DotProduct(const Vector2 &v) const;
     float Length();
 };
 
+// Packed 12 bytes to keep the vertex buffers small, the batch transforms load them with SIMD
 class Vector3
 {
 public:
-    double x;
-    double y;
-    double z;
+    float x;
+    float y;
+    float z;
 
     friend std::ostream &operator<<(std::ostream &os, const Vector3 &v);
     Vector3 operator+(const Vector3 &v) const;
@@ -44,7 +45,7 @@ public:
     float DotProduct(const Vector3 &v) const;
 
     Vector3() = default;
-    Vector3(double x, double y, double z) : x(x), y(y), z(z){};
+    Vector3(float x, float y, float z) : x(x), y(y), z(z){};
     void Normalize();
     void Rotate(Vector3 angles);
     float Length();
@@ -82,21 +83,42 @@ public:
     }
 };
 
-class Vector4
+// Aligned to 16 bytes so it can be loaded into a single SSE register
+class alignas(16) Vector4
 {
 public:
-    double x{0};
-    double y{0};
-    double z{0};
-    double w{0};
+    float x{0};
+    float y{0};
+    float z{0};
+    float w{0};
 
     Vector4() = default;
-    Vector4(double x, double y, double z, double w) : x(x), y(y), z(z), w(w) {};
+    Vector4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {};
     Vector4(Vector3 v) : x(v.x), y(v.y), z(v.z), w(1){};
     Vector3 ToVector3();
     Vector2 ToVector2();
 
-    Vector4 operator*(Matrix4 m) const;
+    Vector4 operator*(const Matrix4& m) const;
+};
+
+// World positions in double precision for large-coordinate scenes, they are converted to float
+// only after subtracting the camera position so the precision is kept around the camera
+class Vector3d
+{
+public:
+    double x{0};
+    double y{0};
+    double z{0};
+
+    Vector3d() = default;
+    Vector3d(double x, double y, double z) : x(x), y(y), z(z){};
+    Vector3d(const Vector3 &v) : x(v.x), y(v.y), z(v.z){};
+
+    Vector3d operator+(const Vector3 &v) const;
+    Vector3d &operator+=(const Vector3 &v);
+    Vector3d &operator-=(const Vector3 &v);
+    Vector3 operator-(const Vector3d &v) const;
+    Vector3 ToVector3() const;
 };
 
 #endif
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "window.h"
 #include <math.h>
+#include <algorithm>
+#include "spans.h"
+#include "trianglesetup.h"
 #include "imgui.h"
 #include "imgui_impl_sdl.h"
 #include "imgui_impl_sdlrenderer.h"
@@ -12,12 +15,13 @@ Window::~Window()
 {
     std::cout << "Destroying Window";
 
+    // The render thread can't be using the buffers while they are released
+    renderThread.Wait();
+
     // Liberar la memoria dinámica
-    free(colorBuffer);
     free(depthBuffer);
-
-    // Liberamos la textura del mesh
-    for(size_t i=0;i<meshes.size();i++) meshes[i].Free();
+    free(hiZBuffer);
+    free(visibilityBuffer);
 
     // Liberamos ImGUI
     ImGui_ImplSDLRenderer_Shutdown();
@@ -109,29 +113,33 @@ void Window::Init()
 
 void Window::Setup()
 {
-    // Reservar la memoria requerida en bytes para mantener el color buffer
-    colorBuffer = static_cast<uint32_t *>(malloc(sizeof(uint32_t) * rendererWidth * rendererHeight));
+    // Reservar los color buffers con las texturas SDL utilizadas para mostrarlos
+    for (int i = 0; i < ColorBufferCount; i++)
+    {
+        colorBuffers[i].Create(renderer, rendererWidth, rendererHeight);
+    }
+    colorBuffer = colorBuffers[0].pixels;
     // Reservar la memoria para el depth buffer
     depthBuffer = static_cast<float*>(malloc(sizeof(float) * rendererWidth * rendererHeight));
-    // Crear la textura SDL utilizada para mostrar el color buffer
-    colorBufferTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, rendererWidth, rendererHeight);
-
-    /* Mesh loading */
-    meshes.push_back(
-        Mesh(this, "res/cube.obj", "res/cube.png", Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(-3, 0, 8)));
-    meshes.push_back(
-        Mesh(this, "res/cube.obj", "res/cube.png", Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(0, 0, 8)));
-    meshes.push_back(
-        Mesh(this, "res/cube.obj", "res/cube.png", Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(3, 0, 8)));
-    meshes.push_back(
-        Mesh(this, "res/cube.obj", "res/cube.png", Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(-1.5, 3, 8)));
-    meshes.push_back(
-        Mesh(this, "res/cube.obj", "res/cube.png", Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(1.5, 3, 8)));
-    meshes.push_back(
-        Mesh(this, "res/cube.obj", "res/cube.png", Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(0, 6, 8)));
-
-    // Send the loaded meshes to the render engine
-    renderEngine.SetMeshes(meshes);
+    // Reservar la memoria para la profundidad más lejana de cada bloque del depth buffer
+    hiZWidth = (rendererWidth + HiZBlockSize - 1) / HiZBlockSize;
+    hiZHeight = (rendererHeight + HiZBlockSize - 1) / HiZBlockSize;
+    hiZBuffer = static_cast<float*>(malloc(sizeof(float) * hiZWidth * hiZHeight));
+    // Reservar la memoria para el visibility buffer
+    visibilityBuffer = static_cast<uint32_t*>(malloc(sizeof(uint32_t) * rendererWidth * rendererHeight));
+
+    /* Mesh loading: the cubes share the geometry and the texture, each instance only has its transform */
+    Mesh cube(this, "res/cube.obj", "res/cube.png");
+    cube.AddInstance(Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(-3, 0, 8));
+    cube.AddInstance(Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(0, 0, 8));
+    cube.AddInstance(Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(3, 0, 8));
+    cube.AddInstance(Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(-1.5, 3, 8));
+    cube.AddInstance(Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(1.5, 3, 8));
+    cube.AddInstance(Vector3(1, 1, 1), Vector3(0, 0, 0), Vector3(0, 6, 8));
+
+    // Move the loaded meshes to the render engine, without copying their geometry
+    renderEngine.SetWindow(this);
+    renderEngine.AddMesh(std::move(cube));
 }
 
 void Window::ProcessInput()
@@ -150,6 +158,10 @@ void Window::ProcessInput()
         case SDL_KEYDOWN:
             if (event.key.keysym.sym == SDLK_ESCAPE) running = false;
             break;
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            RestoreColorBuffers(event.type == SDL_RENDER_DEVICE_RESET);
+            break;
         case SDL_MOUSEBUTTONDOWN:
             mouseClicked = true;
             break;
@@ -234,6 +246,10 @@ void Window::Update()
     // Iniciar el temporizador de cap
     if (enableCap) capTimer.start();
 
+    // The previous frame is finished before changing anything it reads, then it's the one to present
+    FinishColorBuffer();
+    PresentColorBuffer();
+
     // Start ImGui Frame
     ImGui_ImplSDLRenderer_NewFrame();
     ImGui_ImplSDL2_NewFrame(window);
@@ -266,6 +282,28 @@ void Window::Update()
     ImGui::Checkbox("Dibujar triángulos", &this->drawFilledTriangles);
     ImGui::Checkbox("Dibujar texturas", &this->drawTexturedTriangles);
     ImGui::Checkbox("Back-face culling", &this->enableBackfaceCulling);
+    ImGui::Text("Hilos de geometría y rasterizado");
+    ImGui::SliderInt("Hilos", &this->rasterThreads, 1, this->maxRasterThreads);
+    ImGui::Checkbox("Solapar geometría y rasterizado (+1 frame de latencia)", &this->pipelineFrames);
+    ImGui::Text("Frames sin cambios: %d geometría, %d imagen", renderEngine.GetStaticFrameCount(), skippedFrames);
+    ImGui::Checkbox("Spans SIMD", &this->enableSimdSpans);
+    ImGui::SameLine();
+    ImGui::Text("(%s)", GetSpanKernelName(simdSpanKernel));
+    ImGui::Checkbox("Hierarchical-Z", &this->enableHiZ);
+    ImGui::Checkbox("Visibility buffer", &this->enableVisibilityBuffer);
+    ImGui::Checkbox("Frustum culling", &this->enableFrustumCulling);
+    ImGui::Text("Instancias descartadas: %d / %d", renderEngine.GetCulledInstanceCount(), renderEngine.GetInstanceCount());
+    ImGui::Text("Caché: %d aciertos, %d fallos, %.1f KB", resourceCache.GetHitCount(), resourceCache.GetMissCount(), resourceCache.GetResidentBytes() / 1024.0f);
+    ImGui::Checkbox("Niveles de detalle (LOD)", &this->enableLOD);
+    ImGui::SliderFloat("Radio LOD", &this->lodScreenRadius, 25, 800);
+    ImGui::Text("Caras LOD: %zu / %zu", renderEngine.GetFaceCount(), renderEngine.GetFullDetailFaceCount());
+    ImGui::Checkbox("Culling de meshlets", &this->enableMeshletCulling);
+    ImGui::Text("Meshlets descartados: %d / %d", renderEngine.GetCulledMeshletCount(), renderEngine.GetMeshletCount());
+    ImGui::Text("Mallas reutilizadas: %d", renderEngine.GetReusedMeshCount());
+    ImGui::Text("Arena del frame: %.1f / %.1f KB", renderEngine.GetFrameArenaUsedBytes() / 1024.0f, renderEngine.GetFrameArenaCapacity() / 1024.0f);
+#ifdef _DEBUG
+    ImGui::Text("Reservas de memoria en el frame: %d", renderEngine.GetFrameHeapAllocationCount());
+#endif
     ImGui::Separator();
     ImGui::Text("Debugging");
     ImGui::Checkbox("Dibujar cuadrícula", &this->drawGrid);
@@ -294,6 +332,7 @@ void Window::Update()
     ImGui::Separator();
     ImGui::Text("Campo de visión");
     ImGui::SliderFloat("Fov", &this->fovInGrades, 30, 120);
+    ImGui::SliderFloat("Banda de guarda", &this->guardBand, 1, 8);
     ImGui::End();
 
     // Rendering window
@@ -302,7 +341,7 @@ void Window::Update()
     ImGui::SetNextWindowPos(ImVec2(14, 31));
     ImGui::Begin("Rendering", NULL, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoCollapse);
     rendererDragged = ImGui::IsItemHovered();
-    ImGui::Image(colorBufferTexture, ImVec2(rendererWidth, rendererHeight));
+    ImGui::Image(colorBuffers[displayedBuffer >= 0 ? displayedBuffer : 0].texture, ImVec2(rendererWidth, rendererHeight));
     rendererFocused = ImGui::IsWindowFocused();
     rendererHovered = ImGui::IsWindowHovered();
     ImGui::SetCursorPosX(10);
@@ -318,20 +357,24 @@ void Window::Update()
     deltaTime = ImGui::GetIO().DeltaTime;
 
     // Update Model Settings
-    /*for (size_t i = 0; i < meshes.size(); i++) {
-        meshes[i].SetScale(modelScale);
-        meshes[i].SetRotation(modelRotation);
-        meshes[i].SetTranslation(modelTranslation);
+    /*for (int i = 0; i < renderEngine.GetMeshCount(); i++) {
+        renderEngine.GetMesh(i).SetScale(0, modelScale);
+        renderEngine.GetMesh(i).SetRotation(0, modelRotation);
+        renderEngine.GetMesh(i).SetTranslation(0, modelTranslation);
     }*/
 
     // Update Camera Position
     camera.position = Vector3(cameraPosition[0], cameraPosition[1], cameraPosition[2]);
 
-    // Update the Projection Matrix and thr Frustum
-    fovFactorY = M_PI / (180 / fovInGrades);  // in radians
-    fovFactorX = 2 * atan(tan(fovFactorY / 2) * aspectRatioX);  // in radians
-    projectionMatrix = Matrix4::PerspectiveMatrix(fovFactorY, aspectRatioY, zNear, zFar);
-    viewFrustum = Frustum(fovFactorX, fovFactorY, zNear, zFar);
+    // Update the Projection Matrix and thr Frustum, only when the field of view has changed
+    if (fovInGrades != projectionFovInGrades)
+    {
+        projectionFovInGrades = fovInGrades;
+        fovFactorY = M_PI / (180 / fovInGrades);  // in radians
+        fovFactorX = 2 * atan(tan(fovFactorY / 2) * aspectRatioX);  // in radians
+        projectionMatrix = Matrix4::PerspectiveMatrix(fovFactorY, aspectRatioY, zNear, zFar);
+        viewFrustum = Frustum(fovFactorX, fovFactorY, zNear, zFar);
+    }
 
     // Update Screen Ticks si han sido mofificados
     screenTicksPerFrame = 1000 / this->fpsCap;
@@ -339,6 +382,11 @@ void Window::Update()
     // Update the light position
     light.direction = Vector3(lightPosition[0], lightPosition[1], lightPosition[2]);
 
+    // Update the number of geometry and rasterization threads and the pixel kernel
+    renderEngine.SetThreadCount(rasterThreads, pipelineFrames);
+    spanKernel = enableSimdSpans ? simdSpanKernel : DrawSpanScalar;
+    shadeKernel = enableSimdSpans ? simdShadeKernel : ShadeSpanScalar;
+
     // Custom objects update
     //mesh.Update();
 
@@ -348,15 +396,20 @@ void Window::Update()
 void Window::Render()
 {
 
-    // Clear color buffer
-    ClearColorBuffer(static_cast<uint32_t>(0xFF404040));
-
-    // Render the background grid
-    if (this->drawGrid) DrawGrid(0xFF616161);
-
-    // Custom objects render
-    //mesh.Render();
-    renderEngine.Render();
+    // Without new geometry nor other options the image would be the same, the last one is still presented
+    unsigned int settings = GetRasterSettings();
+    if (!renderEngine.HasNewGeometry() && settings == rasterSettings && !colorBuffersLost && displayedBuffer >= 0)
+    {
+        skippedFrames++;
+    }
+    else
+    {
+        // Rasterize the frame in the render thread while the last finished one is presented
+        rasterSettings = settings;
+        colorBuffersLost = false;
+        BeginColorBuffer();
+        renderThread.Start(renderTask);
+    }
 
     // Renderizamos el frame de ImGui
     ImGui::Render();
@@ -369,17 +422,34 @@ void Window::Render()
     PostRender();
 }
 
-void Window::PostRender()
+void Window::RasterizeFrame()
 {
+    // Clear color buffer
+    ClearColorBuffer(static_cast<uint32_t>(0xFF404040));
 
-    // Renderizar el color buffer
-    RenderColorBuffer();
+    // Render the background grid
+    if (this->drawGrid) DrawGrid(0xFF616161);
 
-    // Antes de presentar llamamos al SDL Renderer de ImGUI
-    ImGui_ImplSDLRenderer_RenderDrawData(ImGui::GetDrawData());
+    // Custom objects render
+    //mesh.Render();
+    renderEngine.Render();
 
-    // Clear depth buffer rendeer present
+    // Clear depth buffer for the next frame
     ClearDepthBuffer();
+}
+
+unsigned int Window::GetRasterSettings() const
+{
+    // The options read by the rasterizer and not by the geometry stage, one bit each
+    return (drawGrid << 0) | (drawWireframe << 1) | (drawWireframeDots << 2) | (drawFilledTriangles << 3) |
+        (drawTexturedTriangles << 4) | (enableSimdSpans << 5) | (enableHiZ << 6) | (enableVisibilityBuffer << 7);
+}
+
+void Window::PostRender()
+{
+
+    // Antes de presentar llamamos al SDL Renderer de ImGUI, con el último color buffer terminado
+    ImGui_ImplSDLRenderer_RenderDrawData(ImGui::GetDrawData());
 
     // Finalmente actualizar la pantalla
     SDL_RenderPresent(renderer);
@@ -396,6 +466,64 @@ void Window::PostRender()
     }
 }
 
+void Window::BeginColorBuffer()
+{
+    // Take the buffer that isn't displayed, only that one is kept between frames
+    renderingBuffer = displayedBuffer == 0 ? 1 : 0;
+
+    // Lock it here, the SDL calls can't be made from the render thread
+    ColorBuffer& buffer = colorBuffers[renderingBuffer];
+    buffer.Lock();
+    buffer.state = ColorBuffer::State::Rendering;
+    colorBuffer = buffer.pixels;
+}
+
+void Window::FinishColorBuffer()
+{
+    renderThread.Wait();
+    if (renderingBuffer < 0) return;
+
+    // Give the frame to its texture, it's presented next
+    colorBuffers[renderingBuffer].Unlock();
+    colorBuffers[renderingBuffer].state = ColorBuffer::State::Ready;
+    renderingBuffer = -1;
+}
+
+void Window::PresentColorBuffer()
+{
+    // Show the finished frame in place of the displayed one, which is free for the next frame
+    int finished = -1;
+    for (int i = 0; i < ColorBufferCount; i++)
+    {
+        if (colorBuffers[i].state == ColorBuffer::State::Ready) finished = i;
+    }
+    if (finished == -1) return;
+
+    if (displayedBuffer >= 0) colorBuffers[displayedBuffer].state = ColorBuffer::State::Free;
+    colorBuffers[finished].state = ColorBuffer::State::Displayed;
+    displayedBuffer = finished;
+}
+
+void Window::RestoreColorBuffers(bool recreateTextures)
+{
+    // The render thread can't be writing in a texture being replaced
+    FinishColorBuffer();
+
+    // After a reset of the device all the textures must be created again, also the ones of ImGui
+    if (recreateTextures)
+    {
+        for (int i = 0; i < ColorBufferCount; i++)
+        {
+            colorBuffers[i].CreateTexture(renderer);
+        }
+        ImGui_ImplSDLRenderer_DestroyDeviceObjects();
+        ImGui_ImplSDLRenderer_CreateDeviceObjects();
+    }
+
+    // The pixels of the textures may be gone, a frame without changes is rasterized again anyway
+    colorBuffersLost = true;
+}
+
 void Window::ClearColorBuffer(uint32_t color)
 {
     for (size_t y = 0; y < rendererHeight; y++)
@@ -416,14 +544,52 @@ void Window::ClearDepthBuffer()
             depthBuffer[(rendererWidth * y) + x] = 1.0;
         }
     }
+
+    // The farthest depth of every block is also the clear value
+    for (size_t i = 0; i < hiZWidth * hiZHeight; i++)
+    {
+        hiZBuffer[i] = 1.0;
+    }
+}
+
+void Window::UpdateHiZBlocks(int blockY, int blockMinX, int blockMaxX)
+{
+    // Recalculate the farthest depth of the blocks from the pixels of the depth buffer
+    int yStart = blockY * HiZBlockSize;
+    int yEnd = std::min(yStart + HiZBlockSize, rendererHeight);
+
+    for (int blockX = blockMinX; blockX <= blockMaxX; blockX++)
+    {
+        int xStart = blockX * HiZBlockSize;
+        int xEnd = std::min(xStart + HiZBlockSize, rendererWidth);
+        float farthestDepth = 0;
+
+        for (int y = yStart; y < yEnd; y++)
+        {
+            const float* depthRow = depthBuffer + rendererWidth * y;
+            for (int x = xStart; x < xEnd; x++)
+            {
+                farthestDepth = std::max(farthestDepth, depthRow[x]);
+            }
+        }
+
+        hiZBuffer[hiZWidth * blockY + blockX] = farthestDepth;
+    }
 }
 
-void Window::RenderColorBuffer()
+ScreenRect Window::GetRendererRect()
 {
-    // Copiar el color buffer y su contenido a la textura de imgui
-    // Así podremos dibujar la textura en el renderer
-    SDL_UpdateTexture(colorBufferTexture, NULL, colorBuffer, rendererWidth * sizeof(uint32_t));
-    //SDL_RenderCopy(renderer, colorBufferTexture, NULL, NULL);
+    ScreenRect rect;
+    rect.minX = 0;
+    rect.minY = 0;
+    rect.maxX = rendererWidth - 1;
+    rect.maxY = rendererHeight - 1;
+    return rect;
+}
+
+uint32_t* Window::GetColorBuffer()
+{
+    return colorBuffer;
 }
 
 void Window::DrawGrid(unsigned int color)
@@ -451,88 +617,6 @@ void Window::DrawPixel(int x, int y, unsigned int color)
     }
 }
 
-void Window::DrawTexel(int x, int y, Vector4 a, Vector4 b, Vector4 c, Texture2 t0, Texture2 t1, Texture2 t2, float *uDivW, float* vDivW, float* oneDivW, uint32_t *texture, int textureWidth, int textureHeight)
-{
-    // Create p vector with current pixel location
-    Vector2 p{ static_cast<double>(x),static_cast<double>(y) };
-    // Calculate the weights using the vectors A,B,C and P
-    Vector3 weights = Vector3::BarycentricWeights(a.ToVector2(), b.ToVector2(), c.ToVector2(), p);
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    // Variables to store the interpolated values of U, V and also the reciprocal 1/w for the current pixel
-    float interpolatedU;
-    float interpolatedV;
-    float interpolatedReciprocalW;
-
-    // Calculate the interpolations multipling every U/w and V/w coord per its weight factor per 1/w
-    interpolatedU = uDivW[0] * alpha + uDivW[1] * beta + uDivW[2] * gamma;
-    interpolatedV = vDivW[0] * alpha + vDivW[1] * beta + vDivW[2] * gamma;
-
-    // Find the interpolate value of 1/w for the current pixel
-    interpolatedReciprocalW = oneDivW[0] * alpha + oneDivW[1] * beta + oneDivW[2] * gamma;
-
-    // Now we can divide back both interpolated values by 1/w
-    interpolatedU /= interpolatedReciprocalW;
-    interpolatedV /= interpolatedReciprocalW;
-
-    // Calculate the texelX and texelY based on the interpolated UV and the texture sizes
-    int texelX = abs(static_cast<int>(interpolatedU * textureWidth)) % textureWidth;
-    int texelY = abs(static_cast<int>(interpolatedV * textureHeight)) % textureHeight;
-
-    // Adjust the reciprocal 1/w to the contrary distance. E.g. 0.1 -> 0.9
-    interpolatedReciprocalW = 1 - interpolatedReciprocalW;
-
-    // Security check to not draw outside the buffers size
-    int bufferPosition = this->rendererWidth * y + x;
-    if (bufferPosition >= 0 && bufferPosition <= (this->rendererWidth * this->rendererHeight)) {
-        // Only draw the pixel if the depth value is less than the one previously stored in the depth buffer
-        if (interpolatedReciprocalW < this->depthBuffer[(this->rendererWidth * y) + x])
-        {
-            // Finally draw the pixel with the color stored in our texture harcoded array
-            DrawPixel(x, y, texture[(textureWidth * texelY) + texelX]);
-
-            // And update the depth for the pixel in the depthBuffer
-            this->depthBuffer[(this->rendererWidth * y) + x] = interpolatedReciprocalW;
-        }
-    }
-}
-
-void Window::DrawTrianglePixel(int x, int y, Vector4 a, Vector4 b, Vector4 c, float* oneDivW, uint32_t color)
-{
-    // Create p vector with current pixel location
-    Vector2 p{ static_cast<double>(x),static_cast<double>(y) };
-    // Calculate the weights using the vectors A,B,C and P
-    Vector3 weights = Vector3::BarycentricWeights(a.ToVector2(), b.ToVector2(), c.ToVector2(), p);
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    // Variables to store the interpolated values of U, V and also the reciprocal 1/w for the current pixel
-    float interpolatedReciprocalW;
-
-    // Find the interpolate value of 1/w for the current pixel
-    interpolatedReciprocalW = oneDivW[0] * alpha + oneDivW[1] * beta + oneDivW[2] * gamma;
-
-    // Adjust the reciprocal 1/w to the contrary distance. E.g. 0.1 -> 0.9
-    interpolatedReciprocalW = 1 - interpolatedReciprocalW;
-
-    // Security check to not draw outside the buffers size
-    int bufferPosition = (rendererWidth * y) + x;
-    if (bufferPosition >= 0 && bufferPosition <= (this->rendererWidth * this->rendererHeight)) {
-        // Only draw the pixel if the depth value is less than the one previously stored in the depth buffer
-        if (interpolatedReciprocalW < this->depthBuffer[bufferPosition])
-        {
-            // Finally draw the pixel with the solid color
-            DrawPixel(x, y, color);
-
-            // And update the depth for the pixel in the depthBuffer
-            this->depthBuffer[bufferPosition] = interpolatedReciprocalW;
-        }
-    }
-}
-
 void Window::DrawRect(int sx, int sy, int width, int height, uint32_t color)
 {
     for (size_t y = sy; (y < sy + static_cast<__int64>(height)) && (y < rendererHeight); y++)
@@ -677,9 +761,9 @@ void Window::DrawLine3D(int x0, int y0, float w0, int x1, int y1, float w1, uint
         float oneOverW = 1.0 / (w0 + (wInc * i));
         float zInterpolated = 1.0f - oneOverW;
 
-        // Security check
+        // Security check, the lines can go outside the screen up to the clipping guard band
         int bufferPosition = (rendererWidth * y) + x;
-        if (bufferPosition >= 0 && bufferPosition <= (this->rendererWidth * this->rendererHeight)) {
+        if (x >= 0 && x < rendererWidth && y >= 0 && y < rendererHeight) {
             // Si el valor en Z es menor que el del bufer es que está más cerca
             if (zInterpolated < depthBuffer[bufferPosition])
             {
@@ -725,201 +809,151 @@ void Window::SwapTextures(Texture2* a, Texture2* b)
     *b = tmp;
 }
 
-void Window::DrawTexturedTriangle(int x0, int y0, float z0, float w0, Texture2 uv0, int x1, int y1, float z1, float w1, Texture2 uv1, int x2, int y2, float z2, float w2, Texture2 uv2, uint32_t* texture, int textureWidth, int textureHeight)
+void Window::DrawTexturedTriangle(int x0, int y0, float z0, float w0, Texture2 uv0, int x1, int y1, float z1, float w1, Texture2 uv1, int x2, int y2, float z2, float w2, Texture2 uv2, uint32_t* texture, int textureWidth, int textureHeight, ScreenRect clip)
 {
-    // Iterar todos los píxeles del triángulo para renderizarlos en función del color de la textura
-
-    // Reordenamiento de los vértices y las UV coords: y0 < y1 < y2
-    if (y0 > y1) // Primer intercambio
-    {
-        SwapIntegers(&y0, &y1);
-        SwapIntegers(&x0, &x1);
-        SwapFloats(&z0, &z1);
-        SwapFloats(&w0, &w1);
-        SwapTextures(&uv0, &uv1);
-    }
-    if (y1 > y2) // Segundo intercambio
-    {
-        SwapIntegers(&y1, &y2);
-        SwapIntegers(&x1, &x2);
-        SwapFloats(&z1, &z2);
-        SwapFloats(&w1, &w2);
-        SwapTextures(&uv1, &uv2);
-    }
-    if (y0 > y1) // Tercer intercambio
-    {
-        SwapIntegers(&y0, &y1);
-        SwapIntegers(&x0, &x1);
-        SwapFloats(&z0, &z1);
-        SwapFloats(&w0, &w1);
-        SwapTextures(&uv0, &uv1);
-    }
-
     // Flip the V component to account for inverted UV-coordinates
     uv0.v = 1 - uv0.v;
     uv1.v = 1 - uv1.v;
     uv2.v = 1 - uv2.v;
 
-    // Create vector points for texturing after sorting the vertices
-    Vector4 pA{ (double)x0, (double)y0, (double)z0, (double)w0 };
-    Vector4 pB{ (double)x1, (double)y1, (double)z1, (double)w1 };
-    Vector4 pC{ (double)x2, (double)y2, (double)z2, (double)w2 };
+    // El rasterizador de funciones de arista se encarga de todo el triángulo
+    RasterizeTriangle(x0, y0, w0, uv0, x1, y1, w1, uv1, x2, y2, w2, uv2, 0xFFFFFFFF, texture, textureWidth, textureHeight, colorBuffer, clip);
+}
 
-    // Common divisions for texel drawing in all the triangle face
-    float uDivW[3] = { uv0.u / pA.w , uv1.u / pB.w, uv2.u / pC.w };
-    float vDivW[3] = { uv0.v / pA.w , uv1.v / pB.w, uv2.v / pC.w };
-    float oneDivW[3] = { 1 / pA.w , 1 / pB.w, 1 / pC.w };
+void Window::DrawFilledTriangle(int x0, int y0, float z0, float w0, int x1, int y1, float z1, float w1, int x2, int y2, float z2, float w2, uint32_t color, ScreenRect clip)
+{
+    // Sin textura las coordenadas UV no se utilizan
+    Texture2 uv{ 0, 0 };
 
-    /*** Render the upper part of the triangle (flat bottom) ***/
-    {
-        float m1 = 0;
-        float m2 = 0;
+    // El rasterizador de funciones de arista se encarga de todo el triángulo
+    RasterizeTriangle(x0, y0, w0, uv, x1, y1, w1, uv, x2, y2, w2, uv, color, nullptr, 0, 0, colorBuffer, clip);
+}
 
-        // Checks to avoid infinite divisions
-        if (y1 - y0 != 0) m1 = -((y1 - y0) / static_cast<float>((x0 - x1))); // m1 izquierda -
-        if (y2 - y0 != 0) m2 = (y2 - y0) / static_cast<float>((x2 - x0));    // m2 derecha +
-        if (y1 - y0 != 0)
-        {
-            for (size_t i = 0; i < (y1 - y0); i++)
-            {
-                int xStart = x0 + (i / m1);
-                int xEnd = x0 + (i / m2);
-                int y = y0 + i;
+void Window::RasterizeTriangle(int x0, int y0, float w0, Texture2 uv0, int x1, int y1, float w1, Texture2 uv1, int x2, int y2, float w2, Texture2 uv2, uint32_t color, uint32_t* texture, int textureWidth, int textureHeight, uint32_t* targetBuffer, ScreenRect clip)
+{
+    // Edge equations and interpolation planes, degenerated triangles don't cover any pixel
+    TriangleSetup setup;
+    if (!setup.Setup(x0, y0, w0, uv0, x1, y1, w1, uv1, x2, y2, w2, uv2)) return;
 
-                // Sometimes we have to draw the triangle from right to left
-                // so we have to swap the xStart and the xEnd
-                if (xEnd < xStart) SwapIntegers(&xEnd, &xStart);
+    // Bounding box of the triangle clamped to the clip area, so no per-pixel bounds check is needed
+    // The clip area is the whole renderer or the tile being rasterized by the current thread
+    int minX = std::max(std::min(std::min(x0, x1), x2), clip.minX);
+    int minY = std::max(std::min(std::min(y0, y1), y2), clip.minY);
+    int maxX = std::min(std::max(std::max(x0, x1), x2), clip.maxX);
+    int maxY = std::min(std::max(std::max(y0, y1), y2), clip.maxY);
+    if (minX > maxX || minY > maxY) return;
 
-                for (int x = xStart; x < xEnd; x++)
-                {
-                    //DrawPixel(x, y, (x % 2 == 0) ? 0xFFFFF00FF : 0xFF000000);
-                    DrawTexel(x, y, pA, pB, pC, uv0, uv1, uv2, uDivW, vDivW, oneDivW, texture, textureWidth, textureHeight);
-                }
-            }
-        }
-    }
+    float nearestDepth = setup.NearestDepth();
 
-    /*** Render the lower part of the triangle (flat top) ***/
+    // Hierarchical-Z: discard the whole triangle if it's behind the farthest depth of every block it overlaps
+    if (enableHiZ)
     {
-        float m1 = 0;
-        float m2 = 0;
-        // Checks to avoid infinite divisions
-        if (y2 - y1 != 0) m1 = -((y2 - y1) / static_cast<float>((x2 - x1))); // m1 izquierda -
-        if (y2 - y0 != 0) m2 = -((y2 - y0) / static_cast<float>((x2 - x0))); // m2 izquierda -
-        if (y2 - y1 != 0)
+        bool visible = false;
+        for (int blockY = minY / HiZBlockSize; blockY <= maxY / HiZBlockSize && !visible; blockY++)
         {
-            for (size_t i = 0; i <= (y2 - y1); i++)
+            for (int blockX = minX / HiZBlockSize; blockX <= maxX / HiZBlockSize; blockX++)
             {
-                int xStart = x2 + (i / m1);
-                int xEnd = x2 + (i / m2);
-                int y = y2 - i;
-
-                // Sometimes we have to draw the triangle from right to left
-                // so we have to swap the xStart and the xEnd
-                if (xEnd < xStart) SwapIntegers(&xEnd, &xStart);
-
-                for (int x = xStart; x < xEnd; x++)
+                if (nearestDepth < hiZBuffer[hiZWidth * blockY + blockX])
                 {
-                    //DrawPixel(x, y, (x%2 ==0) ? 0xFFFFF00FF : 0xFF000000);
-                    DrawTexel(x, y, pA, pB, pC, uv0, uv1, uv2, uDivW, vDivW, oneDivW, texture, textureWidth, textureHeight);
+                    visible = true;
+                    break;
                 }
             }
         }
+        if (!visible) return;
     }
-}
 
-void Window::DrawFilledTriangle(int x0, int y0, float z0, float w0, int x1, int y1, float z1, float w1, int x2, int y2, float z2, float w2, uint32_t color)
-{
-    // Iterar todos los píxeles del triángulo para renderizarlos en función del color de la textura
-    if (y0 > y1) // Primer intercambio
-    {
-        SwapIntegers(&y0, &y1);
-        SwapIntegers(&x0, &x1);
-        SwapFloats(&z0, &z1);
-        SwapFloats(&w0, &w1);
-    }
-    if (y1 > y2) // Segundo intercambio
-    {
-        SwapIntegers(&y1, &y2);
-        SwapIntegers(&x1, &x2);
-        SwapFloats(&z1, &z2);
-        SwapFloats(&w1, &w2);
-    }
-    if (y0 > y1) // Tercer intercambio
-    {
-        SwapIntegers(&y0, &y1);
-        SwapIntegers(&x0, &x1);
-        SwapFloats(&z0, &z1);
-        SwapFloats(&w0, &w1);
-    }
+    // Edge values in the top-left corner of the bounding box
+    int e0Row = setup.EdgeAt(0, minX, minY);
+    int e1Row = setup.EdgeAt(1, minX, minY);
+    int e2Row = setup.EdgeAt(2, minX, minY);
 
-    // Create vector points for texturing after sorting the vertices
-    Vector4 pA{ (double)x0, (double)y0, (double)z0, (double)w0 };
-    Vector4 pB{ (double)x1, (double)y1, (double)z1, (double)w1 };
-    Vector4 pC{ (double)x2, (double)y2, (double)z2, (double)w2 };
+    RasterSpan span;
+    span.color = color;
+    span.texture = texture;
+    span.textureWidth = textureWidth;
+    span.textureHeight = textureHeight;
 
-    // Common divisions for depth calculations
-    float oneDivW[3] = { 1 / pA.w , 1 / pB.w, 1 / pC.w };
+    // Range of blocks touched by the spans in the current row of blocks, to update their farthest depth
+    int hiZBlockY = minY / HiZBlockSize;
+    int hiZMinX = rendererWidth;
+    int hiZMaxX = -1;
 
-    /*** Render the upper part of the triangle (flat bottom) ***/
+    for (int y = minY; y <= maxY; y++, e0Row += setup.edgeStepY[0], e1Row += setup.edgeStepY[1], e2Row += setup.edgeStepY[2])
     {
-        float m1 = 0;
-        float m2 = 0;
-
-        // Checks to avoid infinite divisions
-        if (y1 - y0 != 0) m1 = -((y1 - y0) / static_cast<float>((x0 - x1))); // m1 izquierda -
-        if (y2 - y0 != 0) m2 = (y2 - y0) / static_cast<float>((x2 - x0));    // m2 derecha +
-        if (y1 - y0 != 0)
+        // Entering a new row of blocks, update the blocks drawn in the previous one
+        if (enableHiZ && y / HiZBlockSize != hiZBlockY)
         {
+            if (hiZMinX <= hiZMaxX) UpdateHiZBlocks(hiZBlockY, hiZMinX / HiZBlockSize, hiZMaxX / HiZBlockSize);
+            hiZBlockY = y / HiZBlockSize;
+            hiZMinX = rendererWidth;
+            hiZMaxX = -1;
+        }
 
-            for (size_t i = 0; i < (y1 - y0); i++)
-            {
-                int xStart = x0 + (i / m1);
-                int xEnd = x0 + (i / m2);
-                int y = y0 + i;
-                
-                // Sometimes we have to draw the triangle from right to left
-                // so we have to swap the xStart and the xEnd
-                if (xEnd < xStart) SwapIntegers(&xEnd, &xStart);
-
-                for (int x = xStart; x < xEnd; x++)
-                {
-                    uint32_t newColor = color;
-                    //if (xStart == 0) newColor = 0xFF000000;
-                    DrawTrianglePixel(x, y, pA, pB, pC, oneDivW, newColor);
-                }
-            }
+        // Find the exact run of pixels of the row inside the three edges, E(k) = eRow + eStepX*k >= 0
+        int kStart = 0;
+        int kEnd = maxX - minX;
+        if (!ClampSpanToEdge(e0Row, setup.edgeStepX[0], &kStart, &kEnd)) continue;
+        if (!ClampSpanToEdge(e1Row, setup.edgeStepX[1], &kStart, &kEnd)) continue;
+        if (!ClampSpanToEdge(e2Row, setup.edgeStepX[2], &kStart, &kEnd)) continue;
+
+        setup.SetupRow(y, span);
+        span.colorRow = targetBuffer + rendererWidth * y;
+        span.depthRow = depthBuffer + rendererWidth * y;
+        span.xStart = minX + kStart;
+        span.xEnd = minX + kEnd;
+
+        if (!enableHiZ)
+        {
+            // Depth test, texturing and store of the whole span
+            spanKernel(span);
+            continue;
         }
-    }
 
-    /*** Render the lower part of the triangle (flat top) ***/
-    {
-        float m1 = 0;
-        float m2 = 0;
-        // Checks to avoid infinite divisions
-        if (y2 - y1 != 0) m1 = -((y2 - y1) / static_cast<float>((x2 - x1))); // m1 izquierda -
-        if (y2 - y0 != 0) m2 = -((y2 - y0) / static_cast<float>((x2 - x0))); // m2 izquierda -
-        if (y2 - y1 != 0)
+        // Split the span in runs of blocks where the triangle can be in front, skipping the hidden blocks
+        const float* hiZRow = hiZBuffer + hiZWidth * (y / HiZBlockSize);
+        int xEnd = span.xEnd;
+        int x = span.xStart;
+        while (x <= xEnd)
         {
-            for (size_t i = 0; i <= (y2 - y1); i++)
-            {
-                int xStart = x2 + (i / m1);
-                int xEnd = x2 + (i / m2);
-                int y = y2 - i;
+            while (x <= xEnd && nearestDepth >= hiZRow[x / HiZBlockSize]) x = (x / HiZBlockSize + 1) * HiZBlockSize;
+            if (x > xEnd) break;
 
-                // Sometimes we have to draw the triangle from right to left
-                // so we have to swap the xStart and the xEnd
-                if (xEnd < xStart) SwapIntegers(&xEnd, &xStart);
+            span.xStart = x;
+            while (x <= xEnd && nearestDepth < hiZRow[x / HiZBlockSize]) x = (x / HiZBlockSize + 1) * HiZBlockSize;
+            span.xEnd = std::min(x - 1, xEnd);
 
-                for (int x = xStart; x < xEnd; x++)
-                {
-                    uint32_t newColor = color;
-                    // if (xStart == 0) newColor = 0xFF000000;
-                    DrawTrianglePixel(x, y, pA, pB, pC, oneDivW, newColor);
-                }
-            }
+            spanKernel(span);
+            hiZMinX = std::min(hiZMinX, span.xStart);
+            hiZMaxX = std::max(hiZMaxX, span.xEnd);
         }
     }
+
+    // Update the blocks drawn in the last row of blocks
+    if (enableHiZ && hiZMinX <= hiZMaxX) UpdateHiZBlocks(hiZBlockY, hiZMinX / HiZBlockSize, hiZMaxX / HiZBlockSize);
+}
+
+bool Window::ClampSpanToEdge(int edge, int edgeStepX, int* kStart, int* kEnd)
+{
+    if (edgeStepX == 0)
+    {
+        // The edge value is the same in all the row
+        return edge >= 0 && *kStart <= *kEnd;
+    }
+
+    if (edgeStepX > 0)
+    {
+        // The edge grows to the right, the first inside pixel is ceil(-edge / step)
+        if (edge < 0) *kStart = std::max(*kStart, (-edge + edgeStepX - 1) / edgeStepX);
+    }
+    else
+    {
+        // The edge decreases to the right, the last inside pixel is floor(edge / -step)
+        if (edge < 0) return false;
+        *kEnd = std::min(*kEnd, edge / -edgeStepX);
+    }
+
+    return *kStart <= *kEnd;
 }
 
 void Window::FillFlatBottomTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color)
@@ -5,6 +5,8 @@
 #include <SDL.h>
 #include <math.h>
 #include <vector>
+#include <thread>
+#include <algorithm>
 #include "timer.h"
 #include "vector.h"
 #include "mesh.h"
@@ -13,6 +15,11 @@
 #include "camera.h"
 #include "clipping.h"
 #include "engine.h"
+#include "tilebinner.h"
+#include "spans.h"
+#include "resourcecache.h"
+#include "colorbuffer.h"
+#include "threadpool.h"
 
 class Window
 {
@@ -29,9 +36,28 @@ public:
     /* Engine */
     RenderEngine renderEngine;
 
+    /* Models and textures loaded from disk, shared by the meshes using the same files */
+    ResourceCache resourceCache;
+
     /* Depth buffer  */
     float* depthBuffer{ nullptr };
 
+    /* Hierarchical-Z: farthest depth of every block of pixels of the depth buffer */
+    static const int HiZBlockSize = 8;
+    float* hiZBuffer{ nullptr };
+    int hiZWidth{ 0 };
+    int hiZHeight{ 0 };
+
+    /* Visibility buffer: triangle id of the nearest surface of every pixel */
+    static const uint32_t EmptyVisibility = 0xFFFFFFFF;
+    uint32_t* visibilityBuffer{ nullptr };
+
+    /* Pixel kernels for the rasterizer, the SIMD one is selected for the current CPU */
+    SpanKernel simdSpanKernel{ SelectSpanKernel() };
+    SpanKernel simdShadeKernel{ SelectShadeKernel() };
+    SpanKernel spanKernel{ simdSpanKernel };
+    SpanKernel shadeKernel{ simdShadeKernel };
+
     /* Configurable options */
     bool drawGrid = false;
     bool drawWireframe = false;
@@ -40,6 +66,16 @@ public:
     bool drawFilledTriangles = false;
     bool drawTexturedTriangles = true;
     bool enableBackfaceCulling = true;
+    int rasterThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int maxRasterThreads = rasterThreads;
+    bool pipelineFrames = false;  // Geometry of a frame overlapped with the rasterization of the previous one, one frame of latency, the threads are split between both
+    bool enableSimdSpans = true;
+    bool enableHiZ = true;
+    bool enableVisibilityBuffer = false;
+    bool enableFrustumCulling = true;
+    bool enableLOD = true;
+    bool enableMeshletCulling = true;
+    float lodScreenRadius = 200;  // Radius in pixels of the bounding sphere below which the meshes lose detail
 
     /* Model settings */
     float modelScale[3] = {1, 1, 1};
@@ -59,6 +95,7 @@ public:
 
     /* Projection and frustum settings */
     float fovInGrades = 70;
+    float projectionFovInGrades = -1;  // Field of view of the current projection matrix and frustum, none until the first Update
     float fovXInGrades = fovInGrades;
     float fovYInGrades = fovInGrades;
     float fovFactorY = M_PI / (180 / fovInGrades);  // conversion to radians
@@ -66,6 +103,9 @@ public:
     float aspectRatioX;
     float aspectRatioY;
     float zNear = 0.5, zFar = 20.0;
+    // Factor of w that x and y can go outside the screen before clipping, the rasterizer scissor does the rest
+    // Limited to 8 so the integer edge functions of the rasterizer don't overflow
+    float guardBand = 4;
     Matrix4 projectionMatrix;
     Frustum viewFrustum;
 
@@ -83,9 +123,21 @@ private:
     /* Window textures*/
     SDL_Texture* texture{ nullptr };
     SDL_Texture* frameTexture{ nullptr };
-    /* Color buffer */
-    uint32_t* colorBuffer{ nullptr };
-    SDL_Texture *colorBufferTexture{ nullptr };
+    /* Color buffers rotated between the render thread and the presentation in the main thread */
+    /* A frame is rasterized in one while the last finished one is presented from the other */
+    /* The render thread is waited before presenting, so there is never more than one finished frame to show */
+    static const int ColorBufferCount = 2;
+    ColorBuffer colorBuffers[ColorBufferCount];
+    int renderingBuffer = -1;
+    int displayedBuffer = -1;
+    uint32_t* colorBuffer{ nullptr };   // Pixels of the frame being rasterized
+    /* Frames without changes keep showing the last image */
+    unsigned int rasterSettings = 0;    // Options the last frame was rasterized with
+    bool colorBuffersLost = false;      // The renderer lost the textures, the last image can't be shown again
+    int skippedFrames = 0;
+    /* Render thread */
+    BackgroundThread renderThread;
+    std::function<void()> renderTask{ [this] { RasterizeFrame(); } };
     /* Fps */
     int fpsCap = 60;
     int screenRefreshRate = fpsCap;
@@ -94,9 +146,6 @@ private:
     /* Timers */
     Timer capTimer;
 
-    /* Custom objects */
-    std::vector<Mesh> meshes;
-
     /* Event Handling */
     SDL_Event event{};
 
@@ -106,6 +155,7 @@ public:
     {
         aspectRatioX = rendererWidth / static_cast<float>(rendererHeight);
         aspectRatioY = rendererHeight / static_cast<float>(rendererWidth);
+        fovFactorX = 2 * atan(tan(fovFactorY / 2) * aspectRatioX);
         projectionMatrix = Matrix4::PerspectiveMatrix(fovFactorY, aspectRatioY, zNear, zFar);
         viewFrustum = Frustum(fovFactorX, fovFactorY, zNear, zFar);
     };
@@ -120,23 +170,31 @@ public:
     void Render();
     void PostRender();
 
+    void BeginColorBuffer();
+    void FinishColorBuffer();
+    void PresentColorBuffer();
+    void RestoreColorBuffers(bool recreateTextures);
+    void RasterizeFrame();
+    unsigned int GetRasterSettings() const;
     void ClearColorBuffer(uint32_t color);
-    void RenderColorBuffer();
     void ClearDepthBuffer();
+    void UpdateHiZBlocks(int blockY, int blockMinX, int blockMaxX);
+    ScreenRect GetRendererRect();
+    uint32_t* GetColorBuffer();
 
     SDL_HitTestResult SDLCALL DraggableHitTest(SDL_Window* window, const SDL_Point* pt, void* data);
 
     void DrawGrid(unsigned int color);
     void DrawPixel(int sx, int sy, unsigned int color);
-    void DrawTrianglePixel(int x, int y, Vector4 a, Vector4 b, Vector4 c, float* oneDivW, uint32_t color);
-    void DrawTexel(int x, int y, Vector4 a, Vector4 b, Vector4 c, Texture2 t0, Texture2 t1, Texture2 t2, float* uDivW, float* vDivW, float* oneDivW, uint32_t* texture, int textureWidth, int textureHeight);
     void DrawRect(int sx, int sy, int width, int height, uint32_t color);
     void DrawLine(int x0, int y0, int x1, int y1, uint32_t color);
     void DrawLine3D(int x0, int y0, float w0, int x1, int y1, float w1, uint32_t color);
     void DrawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
     void DrawTriangle3D(int x0, int y0, float w0, int x1, int y1, float w1, int x2, int y2, float w2, uint32_t color);
-    void DrawFilledTriangle(int x0, int y0, float z0, float w0, int x1, int y1, float z1, float w1, int x2, int y2, float z2, float w2, uint32_t color);
-    void DrawTexturedTriangle(int x0, int y0, float z0, float w0, Texture2 uv0, int x1, int y1, float z1, float w1, Texture2 uv1, int x2, int y2, float z2, float w2, Texture2 uv2, uint32_t* texture, int textureWidth, int textureHeight);
+    void DrawFilledTriangle(int x0, int y0, float z0, float w0, int x1, int y1, float z1, float w1, int x2, int y2, float z2, float w2, uint32_t color, ScreenRect clip);
+    void DrawTexturedTriangle(int x0, int y0, float z0, float w0, Texture2 uv0, int x1, int y1, float z1, float w1, Texture2 uv1, int x2, int y2, float z2, float w2, Texture2 uv2, uint32_t* texture, int textureWidth, int textureHeight, ScreenRect clip);
+    void RasterizeTriangle(int x0, int y0, float w0, Texture2 uv0, int x1, int y1, float w1, Texture2 uv1, int x2, int y2, float w2, Texture2 uv2, uint32_t color, uint32_t* texture, int textureWidth, int textureHeight, uint32_t* targetBuffer, ScreenRect clip);
+    bool ClampSpanToEdge(int edge, int edgeStepX, int* kStart, int* kEnd);
     void SwapIntegers(int *a, int *b);
     void SwapFloats(float* a, float* b);
     void SwapTextures(Texture2* a, Texture2* b);